@@ -1,664 +1,4569 @@
-//
-// Basic instrumentation profiler by Cherno expanded by danybeam
-// Video link: https://www.youtube.com/watch?v=xlAH4dbMVnU&list=PLlrATfBNZ98dudnM48yfGUldqGD0S4FFb&index=81
-
-// Usage: include this header file somewhere in your code (e.g. precompiled header), and then use like:
-//
-// Instrumentor::Get().BeginSession("Session Name");        // Begin session 
-// {
-//     InstrumentationTimer timer("Profiled Scope Name");   // Place code like this in scopes you'd like to include in profiling
-//     // Code
-// }
-// Instrumentor::Get().EndSession();                        // End Session
-//
-// You will probably want to macro-fy this, to switch on/off easily and use things like __FUNCSIG__ for the profile name.
-//
-// ReSharper disable CppParameterMayBeConstPtrOrRef
-// ReSharper disable CppClangTidyClangDiagnosticNewDelete
-// ReSharper disable CppParameterNamesMismatch
-// ReSharper disable CppClangTidyCppcoreguidelinesSpecialMemberFunctions
-#pragma once
-#pragma warning(push)
-#pragma warning( disable : 4595)
-
-#include <algorithm>
-#include <chrono>
-#include <fstream>
-#include <iostream>
-#include <ranges>
-#include <stacktrace>
-#include <string>
-#include <thread>
-#include <unordered_map>
-
-
-/*
- * Known issues:
- * - The profiling macro needs to be the first thing in the scope to make sure it gets freed last.
- *     - IDK if there's any way around that
- * - This has not been tested in multithreaded apps.
- *     - Even if it could work out of the box IDK what settings should be used. 
- */
-
-/**
- * Mutex-like object to avoid infinite recursion when calling new or delete
- */
-struct ProfileLock // NOLINT(cppcoreguidelines-special-member-functions)
-{
-    /**
-     * ProfileLock constructor, this takes ownership of the lock automatically
-     */
-    ProfileLock()
-    {
-        selfPointer_ = this;
-        // std::cout << "Locking profiler " << selfPointer_ << "\n";
-        semaphore_--;
-    }
-
-    /**
-     * ProfileLock destructor, this releases ownership of the lock automatically
-     */
-    ~ProfileLock()
-    {
-        // std::cout << "Unlocking profiler " << selfPointer_ << "\n";
-        semaphore_++;
-    }
-
-    /**
-     * Get the status of forceLock
-     * @return forceLock_ Whether the lock is being forced or not
-     */
-    static bool GetForceLock()
-    {
-        return forceLock_;
-    }
-
-    /**
-     * Try to activate the force lock
-     * @todo actually 'try' instead of just forcing it.I would need to have some metric of when the lock is absolutely necessary.
-     * This might not be necessary until/unless this "library"(header) becomes multithread safe
-     */
-    static void RequestForceLock()
-    {
-        forceLock_ = true;
-    }
-
-    /**
-     * Try to deactivate the force lock
-     * @todo actually 'try' instead of just forcing it. I would need to have some metric of when the lock is absolutely necessary.
-     * This might not be necessary until/unless this "library"(header) becomes multithread safe
-     */
-    static void RequestForceUnlock()
-    {
-        forceLock_ = false;
-    }
-
-    /**
-     * Get the status of the semaphore value
-     * @remark Mostly for debugging purposes
-     * @return The current status of saveProfiling
-     */
-    static uint8_t GetSaveProfiling()
-    {
-        return semaphore_;
-    }
-
-private:
-    void* selfPointer_; /**< does nothing. Without this the destructor gets called at weird times. */
-
-    static uint8_t semaphore_;
-    /**< Semaphore counter for the lock. Should be defined as one, more than one would work, but it would just get consumed when creating the stack trace. @remark This should change if this becomes multithreaded. IDK how it would behave*/
-    static bool forceLock_; /**< Bool to control whether to override the status of the lock and force it.*/
-};
-
-/**
- * Struct to store the result of a timer profiling
- */
-struct ProfileResult_Time
-{
-    std::string name; /**< The name of what is being profiled. */
-    uint32_t threadId; /**< The thread of the function call being measured. */
-    long long start, end; /**< Time stamp of the profiling */
-};
-
-/**
- * Struct to store the result of a memory profiling
- */
-struct ProfileResult_Memory
-{
-    bool isArray; /**< Whether the memory allocation was for an array or not. */
-    void* location; /**< Pointer to the location that memory is being allocated to. */
-    size_t size; /**< How much memory was allocated. */
-    std::stacktrace stackTrace; /**< The stack trace of where the memory was allocated in code. */
-    long long start, end = -1; /**< Time stamp of the profiling */
-};
-
-/**
- * Struct related to the instrumentation session. Right now it only stores the name of the session.
- */
-struct InstrumentationSession
-{
-    std::string name;
-};
-
-/**
- * Class to manage profiling sessions. It only tracks one concurrent session at a time.
- */
-class Instrumentor
-{
-private:
-    class InstrumentationMemory* m_currentMemoryCheck_ = nullptr; /**< Ref pointer to the current memory profiler. */
-    InstrumentationSession* m_currentSession_; /**< The current instrumentation session going on. */
-    std::ofstream m_outputStream_; /**< handler of the file to write the results into. */
-    int m_profileCount_mem_; /**< Counter of how many entries have been in the memory profiling */
-    int m_profileCount_time_; /**< Counter of how many entries have been in the time profiling */
-
-    /**
-     * Construct the instrumentor with default values.
-     * Made private to prevent having multiple instances.
-     */
-    Instrumentor():
-        m_currentSession_(nullptr),
-        m_profileCount_mem_(0),
-        m_profileCount_time_(0)
-    {
-    }
-
-public:
-    /**
-     * Start a profiling session.
-     * @param name Name of the session
-     * @param filepath Path to save the session info into.
-     */
-    void BeginSession(const std::string& name, const std::string& filepath = "results.json")
-    {
-        if (m_currentSession_)
-        {
-            throw
-                "There is already a profiling session running. Make sure you're not calling START_SESSION(name) more than once";
-        }
-
-        m_outputStream_.open(filepath);
-        WriteHeader();
-        m_currentSession_ = new InstrumentationSession{name};
-    }
-
-    /**
-     * End the current profiling session.
-     * @throws error Errors if trying to end a session before it starts/
-     */
-    void EndSession()
-    {
-        if (!m_currentSession_)
-        {
-            throw "Closing a session was requested even though there's no sessions running.";
-        }
-
-        WriteFooter();
-        m_outputStream_.close();
-        delete m_currentSession_;
-        m_currentSession_ = nullptr;
-        m_profileCount_time_ = 0;
-    }
-
-    /**
-     * Write the profiling data of a timer profiling into the file.
-     * @param profilingData The data of the timer profiling result
-     */
-    void WriteProfile(const ProfileResult_Time& profilingData)
-    {
-        if (m_profileCount_time_++ > 0)
-            m_outputStream_ << ",";
-
-        std::string name = profilingData.name;
-        std::ranges::replace(name, '"', '\'');
-
-        m_outputStream_ << "{";
-        m_outputStream_ << "\"cat\":\"function\",";
-        m_outputStream_ << "\"dur\":" << (profilingData.end - profilingData.start) << ',';
-        m_outputStream_ << "\"name\":\"" << name << "\",";
-        m_outputStream_ << "\"ph\":\"X\",";
-        m_outputStream_ << "\"pid\":0,";
-        m_outputStream_ << "\"tid\":" << profilingData.threadId << ",";
-        m_outputStream_ << "\"ts\":" << profilingData.start;
-        m_outputStream_ << "}";
-
-        m_outputStream_.flush();
-    }
-
-    /**
-     * Write the profiling data of a memory profiling session into the file.
-     * @param profilingData The data of the memory profiling result
-     */
-    void WriteProfile(const ProfileResult_Memory& profilingData)
-    {
-        if (m_currentMemoryCheck_ == nullptr)
-        {
-            throw "A memory instrumentor tried to write before registering";
-        }
-        if (m_profileCount_mem_++ > 0)
-            m_outputStream_ << ",";
-
-        const uint32_t threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
-
-        m_outputStream_ << "{";
-        m_outputStream_ << "\"cat\":\"" << ((profilingData.end >= 0) ? "Deallocated mem" : "Memory leaked") << "\",";
-        m_outputStream_ << "\"dur(us)\":" << ((profilingData.end >= 0) ? (profilingData.end - profilingData.start) : -1)
-            << ',';
-        m_outputStream_ << "\"name\":\"" << profilingData.location << "\",";
-        m_outputStream_ << "\"tid\":" << threadId << ",";
-        m_outputStream_ << "\"tStart\":" << profilingData.start << ",";
-        m_outputStream_ << "\"tEnd\":" << profilingData.end << ",";
-        m_outputStream_ << "\"size\":" << profilingData.size << ",";
-        m_outputStream_ << "\"callStack\":[";
-        for (size_t i = 0; i < profilingData.stackTrace.size(); i++)
-        {
-            std::string stackTraceString = std::to_string(profilingData.stackTrace[i]);
-            std::ranges::replace(stackTraceString, '\\', '/');
-
-            m_outputStream_ << "\"";
-            m_outputStream_ << stackTraceString;
-            m_outputStream_ << "\"";
-            if (i < profilingData.stackTrace.size() - 1)
-            {
-                m_outputStream_ << ",";
-            }
-        }
-        m_outputStream_ << "]";
-        m_outputStream_ << "}";
-
-        m_outputStream_.flush();
-    }
-
-    /**
-     * Write the results file header.
-     */
-    void WriteHeader()
-    {
-        m_outputStream_ << "{\"otherData\": {},\"traceEvents\":[";
-        m_outputStream_.flush();
-    }
-
-    /**
-     * Write the results file footer.
-     */
-    void WriteFooter()
-    {
-        m_outputStream_ << "]}";
-        m_outputStream_.flush();
-    }
-
-    /**
-     * Get the singleton instance
-     * @return A reference to the Instrumentor singleton instance
-     */
-    static Instrumentor& Get()
-    {
-        static Instrumentor instance;
-        return instance;
-    }
-
-    /**
-     * Register a memory profiler to be the active one.
-     * @param instrumentation Pointer to the active memory profiler
-     */
-    static void RegisterInstrumentation(InstrumentationMemory* instrumentation)
-    {
-        if (Instrumentor::Get().m_currentMemoryCheck_)
-        {
-            throw "An instrumentation was already registered";
-        }
-
-        Instrumentor::Get().m_currentMemoryCheck_ = instrumentation;
-    }
-
-    /**
-     * Get the current memory instrumentation.
-     * @return Pointer to the current memory profiler. nullptr if none have been registered.
-     */
-    static InstrumentationMemory* GetCurrentMemoryInstrumentation()
-    {
-        return Instrumentor::Get().m_currentMemoryCheck_;
-    }
-};
-
-/**
- * A class to manage a timer in a scope automatically.
- */
-class InstrumentationTimer final
-{
-public:
-    /**
-     * Create and start a timer with a given name.
-     * @param name Name of the timer
-     */
-    explicit InstrumentationTimer(const char* name)
-        : m_name_(name), m_stopped_(false)
-    {
-        m_startTimepoint_ = std::chrono::high_resolution_clock::now();
-    }
-
-    /**
-     * Destroy and stop a timer.
-     */
-    ~InstrumentationTimer()
-    {
-        if (!m_stopped_)
-            Stop();
-    }
-
-    /**
-     * Stop a timer manually. This is not necessary under normal conditions.
-     */
-    void Stop()
-    {
-        const auto endTimepoint = std::chrono::high_resolution_clock::now();
-
-        const long long start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startTimepoint_).
-                                time_since_epoch().
-                                count();
-        const long long end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().
-            count();
-
-        const uint32_t threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
-        Instrumentor::Get().WriteProfile({m_name_, threadId, start, end});
-
-        m_stopped_ = true;
-    }
-
-private:
-    /**
-     * Name of the timer
-     */
-    const char* m_name_;
-    /**
-     * time point where the timer started.
-     */
-    std::chrono::time_point<std::chrono::high_resolution_clock> m_startTimepoint_;
-    /**
-     * Whether the timer is stoped.
-     * It should stay false during the lifetime of the object under normal conditions.
-     */
-    bool m_stopped_;
-};
-
-/**
- * A class to manage memory profiling in a scope automatically.
- * @remark It should be the first thing created in a stack to ensure that it gets deleted last.
- */
-class InstrumentationMemory final
-{
-public:
-    /**
-     * Create and start a memory profiling object with a given name.
-     * @param name Name of the memory profiler
-     */
-    explicit InstrumentationMemory(const char* name)
-        : m_stopped_(false)
-    {
-        Instrumentor::RegisterInstrumentation(this);
-    }
-
-    /**
-     * Stop and destroy a memory profiling object.
-     */
-    ~InstrumentationMemory()
-    {
-        if (!m_stopped_)
-            Stop();
-    }
-
-    /**
-     * Stop a profiler manually. Under normal conditions it should not be necessary.
-     */
-    void Stop()
-    {
-        ProfileLock lock;
-        for (auto& profileResult : this->m_results_ | std::views::values)
-        {
-            Instrumentor::Get().WriteProfile(profileResult);
-        }
-
-        // std::cout << "Profiling stopped\n";
-        m_stopped_ = true;
-    }
-
-    /**
-     * Register when memory gets allocated.
-     * @param address Memory address of the memory being allocated
-     * @param size size of the memory being allocated
-     * @param isArray boolean indicating whether the memory was allocated for an array
-     */
-    void Register_push(void* address, const size_t size, const bool isArray)
-    {
-        if (m_stopped_) return;
-
-        m_results_[address] = {
-            .isArray = isArray,
-            .location = address,
-            .size = size,
-            .stackTrace = std::stacktrace::current(),
-            .start = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now()).
-                     time_since_epoch().
-                     count()
-        };
-    }
-
-
-    /**
-     * Register memory deallocation.
-     * @param address The address of the memory being deallocated.
-     */
-    void Register_pop(void* address)
-    {
-        if (m_stopped_) return;
-
-        // This used to explode after closing the window, but it doesn't anymore.
-        // I(danybeam) cannot get it to reproduce anymore. If someone can  please fill up an issue in the repo.
-        if (const auto findResult = m_results_.find(address); findResult != m_results_.end())
-        {
-            findResult->second.end = std::chrono::time_point_cast<std::chrono::microseconds>(
-                                         std::chrono::high_resolution_clock::now()).
-                                     time_since_epoch().
-                                     count();
-        }
-    }
-
-private:
-    /**
-     * Name of the memory profiler.
-     */
-    /**
-     * map to track the memory being allocated, deallocated and leaked.
-     */
-    std::unordered_map<void*, ProfileResult_Memory> m_results_;
-    /**
-     * Whether the profiler is stopped. It should be false during the normal operation of the profiler.
-     */
-    bool m_stopped_;
-};
-
-/*
- * These functions have been left uncommented somewhat on purpose.
- * Here's the official documentation for the new operators. https://en.cppreference.com/w/cpp/memory/new/operator_new
- * Here's the official documentation for the delete operators. https://en.cppreference.com/w/cpp/memory/new/operator_delete.html
- *
- * These functions try to do the same things but injecting the profiling tools into them.
- */
-// ReSharper disable once CppInconsistentNaming
-inline void* operator new(size_t size)
-{
-    if (size == 0)
-    {
-        size++;
-    }
-
-    void* ptr = std::malloc(size);
-
-    if (ptr == nullptr)
-    {
-        throw std::bad_alloc();
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            // Because there's no guarantee there will already be an instrumentor active
-            memoryInstrumentation->Register_push(ptr, size, false);
-        // std::cout << "Allocated memory for variable at " << size << " at " << ptr << "\n";
-    }
-    return ptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void* operator new[](size_t size)
-{
-    if (size == 0)
-    {
-        size++;
-    }
-
-    void* ptr = std::malloc(size);
-
-    if (ptr == nullptr)
-    {
-        throw std::bad_alloc();
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            // Because there's no guarantee there will already be an instrumentor active
-            memoryInstrumentation->Register_push(ptr, size, true);
-        // std::cout << "Allocated memory for array at " << size << " at " << ptr << "\n";
-    }
-    return ptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void* operator new(const size_t size, const std::nothrow_t& tag) noexcept
-{
-    void* ptr = std::malloc(size);
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            // Because there's no guarantee there will already be an instrumentor active
-            memoryInstrumentation->Register_push(ptr, ptr ? size : 0, false);
-        // std::cout << "Allocated memory for variable noexcept at " << size << " at " << ptr << "\n";
-    }
-    return ptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void* operator new[](const size_t size, const std::nothrow_t& tag) noexcept
-{
-    void* ptr = std::malloc(size);
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            // Because there's no guarantee there will already be an instrumentor active
-            memoryInstrumentation->Register_push(ptr, ptr ? size : 0, true);
-        // std::cout << "Allocated memory for array noexcept at " << size << " at " << ptr << "\n";
-    }
-    return ptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void operator delete(void* block) noexcept
-{
-    if (block == nullptr)
-    {
-        return;
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            memoryInstrumentation->Register_pop(block);
-        // std::cout << "deleted variable at " << block << "\n";
-    }
-
-    std::free(block);
-    block = nullptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void operator delete[](void* block) noexcept
-{
-    if (block == nullptr)
-    {
-        return;
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            memoryInstrumentation->Register_pop(block);
-        // std::cout << "deleted array at " << block << "\n";
-    }
-
-    std::free(block);
-    block = nullptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void operator delete(void* block, const std::nothrow_t& tag) noexcept
-{
-    if (block == nullptr)
-    {
-        return;
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            memoryInstrumentation->Register_pop(block);
-        // std::cout << "deleted variable noexcept at " << block << "\n";
-    }
-
-    std::free(block);
-    block = nullptr;
-}
-
-// ReSharper disable once CppInconsistentNaming
-inline void operator delete[](void* block, const std::nothrow_t& tag) noexcept
-{
-    if (block == nullptr)
-    {
-        return;
-    }
-
-    if (ProfileLock::GetSaveProfiling() && !ProfileLock::GetForceLock())
-    {
-        ProfileLock lock;
-        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
-            memoryInstrumentation->Register_pop(block);
-        // std::cout << "deleted array noexcept at " << block << "\n";
-    }
-
-    std::free(block);
-    block = nullptr;
-}
-
-/*
-* These preprocessors are used to simplify the creation of the profiler objects.
- */
-// The "if" preprocessor command and the macro commands are a mix of Cherno and danybeam (me)
-// Regardless of the copyright notice on modified versions of the code in the code the section bellow should be considered under the MIT license.
-#pragma once
-#define PROFILE_SCOPE_MEMORY(name) ProfileLock::RequestForceLock();InstrumentationMemory memoryProfiler##__LINE__##(name);ProfileLock::RequestForceUnlock();
-#define PROFILE_SCOPE_TIME(name) InstrumentationTimer timer##__LINE__##(name)
-#define PROFILE_FUNCTION_TIME() PROFILE_SCOPE(__FUNCSIG__)
-#define START_SESSION(name)  Instrumentor::Get().BeginSession(name)
-#define END_SESSION()  Instrumentor::Get().EndSession()
-
-#pragma warning(pop)
+//
+// Basic instrumentation profiler by Cherno expanded by danybeam
+// Video link: https://www.youtube.com/watch?v=xlAH4dbMVnU&list=PLlrATfBNZ98dudnM48yfGUldqGD0S4FFb&index=81
+
+// Usage: include this header file somewhere in your code (e.g. precompiled header), and then use like:
+//
+// Instrumentor::Get().BeginSession("Session Name");        // Begin session 
+// {
+//     InstrumentationTimer timer("Profiled Scope Name");   // Place code like this in scopes you'd like to include in profiling
+//     // Code
+// }
+// Instrumentor::Get().EndSession();                        // End Session
+//
+// Or use the macros at the end of this file (PROFILE_SCOPE_TIME, PROFILE_FUNCTION_TIME, ...). They and the operator new
+// and delete replacements only exist when PROFILE is defined as 1, otherwise they compile to nothing.
+//
+// Sessions can also be written in a compact binary format and converted back to JSON later with trace_format::ConvertToJson:
+//
+// Instrumentor::Get().BeginSession("Session Name", "results.mpvt", TraceFormat::BINARY);
+//
+// Timestamps come from the CPU timestamp counter when available (ClockSource::TSC, the default) and from steady_clock
+// otherwise. Pass ClockSource::STEADY as the last argument of the first BeginSession to always use steady_clock. The
+// clock is calibrated once per process, by the first session or by the first timestamp taken before any session.
+//
+// Entries are buffered in memory and handed to a background writer thread following the flush policy (every 64KiB by
+// default). If the writer can't keep up, the backpressure policy decides whether producers wait, drop entries or let
+// the buffer grow (the default):
+//
+// Instrumentor::Get().SetFlushPolicy(FlushPolicy::EVERY_T_MILLISECONDS, 100);
+// Instrumentor::Get().SetBackpressurePolicy(BackpressurePolicy::DROP, 4 * 1024 * 1024);
+//
+// Instrumentor::Get() is the default session. More sessions, each with its own file and writer thread, can be created
+// as objects. Threads bound to one send their timers and memory profilers there instead of the default session:
+//
+// Instrumentor poolSession;
+// poolSession.BeginSession("Worker pool", "pool.json");
+// poolSession.BindThread();                                 // On every thread of the pool
+//
+// Long runs can aggregate timers into a calling-context tree instead of writing every scope. Each node holds the call
+// count and the total, self, min and max time of one path of scopes, so the trace only grows with the amount of paths:
+//
+// Instrumentor::Get().SetTimerMode(TimerMode::CALL_TREE);   // Before BeginSession
+//
+// Timers and memory profilers can run in the same session. Allocations made while a PROFILE_SCOPE_TIME is open are
+// tagged with its call site (sid) and memory summaries add up the allocations and bytes of every scope.
+//
+// A running program can also be watched live. A memory profiler publishes its events into a shared memory ring that
+// the viewer attaches to with --attach <segment name>:
+//
+// InstrumentationMemory memoryProfiler("Name");
+// memoryProfiler.PublishEvents("MyProgramEvents");
+//
+// Heap usage can be plotted over time by trace viewers without going through every allocation record. The profiler
+// then writes its live bytes and live allocations as counter events from a background thread:
+//
+// memoryProfiler.SampleCounters(std::chrono::milliseconds(10));
+//
+// Programs with a main loop mark where each frame ends. Every frame gets its number, its time and the allocations and
+// bytes allocated during it by the memory profiler of the thread marking it:
+//
+// while (running)
+// {
+//     PROFILE_FRAME_MARK();
+//     // Frame
+// }
+//
+// ReSharper disable CppParameterMayBeConstPtrOrRef
+// ReSharper disable CppClangTidyClangDiagnosticNewDelete
+// ReSharper disable CppParameterNamesMismatch
+// ReSharper disable CppClangTidyCppcoreguidelinesSpecialMemberFunctions
+#pragma once
+#pragma warning(push)
+#pragma warning( disable : 4595)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <source_location>
+#include <sstream>
+#include <stacktrace>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "profiler_shm.h"
+#include "trace_format.h"
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#if defined(_WIN32)
+// Declared by hand because windows.h clashes with raylib. These match the declarations in memoryapi.h.
+extern "C" __declspec(dllimport) void* __stdcall VirtualAlloc(void* address, size_t size, unsigned long allocationType,
+                                                               unsigned long protect);
+extern "C" __declspec(dllimport) int __stdcall VirtualFree(void* address, size_t size, unsigned long freeType);
+#else
+#include <sys/mman.h>
+#endif
+
+// Profiling is compiled in only when PROFILE is 1. Otherwise the allocator hooks and the macros below expand to nothing.
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROFILER_HAS_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILER_HAS_TSC 0
+#endif
+
+
+/*
+ * Known issues:
+ * - The profiling macro needs to be the first thing in the scope to make sure it gets freed last.
+ *     - IDK if there's any way around that
+ */
+
+/**
+ * Mutex-like object to avoid infinite recursion when calling new or delete.
+ * @remark The counters are thread_local so every thread guards its own recursion without contending with the others.
+ */
+struct ProfileLock // NOLINT(cppcoreguidelines-special-member-functions)
+{
+    /**
+     * ProfileLock constructor, this takes ownership of the lock automatically
+     */
+    ProfileLock()
+    {
+        selfPointer_ = this;
+        // std::cout << "Locking profiler " << selfPointer_ << "\n";
+        semaphore_--;
+    }
+
+    /**
+     * ProfileLock destructor, this releases ownership of the lock automatically
+     */
+    ~ProfileLock()
+    {
+        // std::cout << "Unlocking profiler " << selfPointer_ << "\n";
+        semaphore_++;
+    }
+
+    /**
+     * Get the status of the semaphore value
+     * @remark Mostly for debugging purposes
+     * @return The current status of saveProfiling for the calling thread. Nested locks keep it off.
+     */
+    static uint8_t GetSaveProfiling()
+    {
+        return semaphore_ == 1 ? 1 : 0;
+    }
+
+private:
+    void* selfPointer_; /**< does nothing. Without this the destructor gets called at weird times. */
+
+    static inline thread_local uint8_t semaphore_ = 1;
+    /**< Per thread semaphore counter for the lock. Should be defined as one, more than one would work, but it would just get consumed when creating the stack trace.*/
+};
+
+/**
+ * Marks the calling thread as recording into a memory profiler for as long as it lives. Stopping a memory profiler
+ * waits for every guard taken before it got unregistered, so it's never stopped or destroyed under a thread that looked
+ * it up just before. Take it before looking the profiler up, and only when a profiler may be registered.
+ * @remark Threads count themselves into a few stripes on separate cache lines, so they rarely write the same one. Each
+ * stripe has one counter per parity of the epoch, WaitForUsers moves to the next epoch and only waits for the counter
+ * of the previous one, so guards taken while it waits can't keep it waiting.
+ */
+struct MemoryUseGuard // NOLINT(cppcoreguidelines-special-member-functions)
+{
+    /**
+     * MemoryUseGuard constructor, counts the calling thread as a user until the guard gets destroyed
+     */
+    MemoryUseGuard()
+    {
+        Stripe& stripe = stripes_[ThreadStripe()];
+        while (true)
+        {
+            const uint64_t epoch = epoch_.value.load();
+            m_users_ = &stripe.users[epoch & 1];
+            // Sequentially consistent so that the thread either shows up in WaitForUsers or sees the profiler stopped.
+            m_users_->fetch_add(1);
+            // Counted into an epoch that already ended, the waiter may have missed it.
+            if (epoch_.value.load() == epoch)
+            {
+                return;
+            }
+            m_users_->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * MemoryUseGuard destructor, the calling thread stops counting as a user
+     */
+    ~MemoryUseGuard()
+    {
+        m_users_->fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * Wait until every thread that took a guard before this call released it.
+     * @remark The calling thread must not hold a guard itself.
+     */
+    static void WaitForUsers()
+    {
+        // Only one waiter at a time, the next one would reuse the parity this one is waiting on.
+        std::lock_guard waitLock(waitMutex_);
+        const uint64_t parity = epoch_.value.fetch_add(1) & 1;
+        for (const Stripe& stripe : stripes_)
+        {
+            while (stripe.users[parity].load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    /**
+     * Users counted together, aligned to a cache line so that neighbouring stripes don't false share.
+     */
+    struct alignas(64) Stripe
+    {
+        std::array<std::atomic<uint32_t>, 2> users; /**< Threads of this stripe holding a guard, by epoch parity. */
+    };
+
+    /**
+     * Current epoch, on its own cache line since every guard reads it.
+     */
+    struct alignas(64) Epoch
+    {
+        std::atomic<uint64_t> value; /**< Incremented by every WaitForUsers, zero from the start. */
+    };
+
+    /**
+     * Amount of stripes the users are counted in.
+     */
+    static constexpr size_t stripeCount = 16;
+
+    /**
+     * Get the stripe of the calling thread, handed out round robin the first time a thread takes a guard.
+     * @return Index of the stripe
+     */
+    static size_t ThreadStripe()
+    {
+        thread_local const size_t stripe = nextStripe_.fetch_add(1, std::memory_order_relaxed) % stripeCount;
+        return stripe;
+    }
+
+    std::atomic<uint32_t>* m_users_; /**< Counter the calling thread counted itself into. */
+
+    static inline std::array<Stripe, stripeCount> stripes_; /**< Users of every stripe. */
+    static inline Epoch epoch_; /**< Epoch new guards count themselves into. */
+    static inline std::mutex waitMutex_; /**< Lock so only one thread waits for users at a time. */
+    static inline std::atomic<size_t> nextStripe_ = 0; /**< Stripe handed to the next thread. */
+};
+
+/**
+ * Get the object the calling thread registered with an owner, creating and registering it the first time. A small
+ * thread_local cache in front of the owner's list keeps the lock off the hot path.
+ * @remark Owners are told apart by a unique id and not by pointer, a new one can be constructed where an old one lived.
+ * Owners with consecutive ids get different slots, so nested ones can take turns without evicting each other.
+ * @param ownerId Unique id of the owner
+ * @param objects Objects every thread registered with the owner
+ * @param mutex Lock protecting objects
+ * @param thread Projection giving the thread an object belongs to
+ * @return The object of the calling thread, built from its thread id
+ */
+template <typename T, typename Projection>
+T& GetThreadEntry(const uint64_t ownerId, std::vector<std::unique_ptr<T>>& objects, std::mutex& mutex,
+                  Projection thread)
+{
+    struct CacheSlot
+    {
+        uint64_t ownerId = 0;
+        T* object = nullptr;
+    };
+    thread_local std::array<CacheSlot, 8> cache;
+
+    CacheSlot& slot = cache[ownerId % cache.size()];
+    if (slot.ownerId != ownerId)
+    {
+        const std::thread::id self = std::this_thread::get_id();
+        ProfileLock lock;
+        std::lock_guard objectsLock(mutex);
+        // The slot could have been evicted by another owner, reuse what this thread registered before.
+        const auto found = std::ranges::find(objects, self, thread);
+        slot.object = found != objects.end() ? found->get() : objects.emplace_back(std::make_unique<T>(self)).get();
+        slot.ownerId = ownerId;
+    }
+    return *slot.object;
+}
+
+/**
+ * Sources the profiler can read timestamps from.
+ */
+enum class ClockSource : uint8_t
+{
+    STEADY, /**< std::chrono::steady_clock, one tick per nanosecond. Available everywhere. */
+    TSC /**< CPU timestamp counter. Only on x86-64 CPUs with an invariant counter, otherwise STEADY gets used. */
+};
+
+/**
+ * Timestamp source of every profiler. Timestamps are kept as raw ticks while profiling and only turned into time when
+ * they get written. The source is calibrated once, the first time it's used, so every timestamp of the process is
+ * taken with the same calibration.
+ */
+class ProfileClock
+{
+public:
+    /**
+     * Read the current timestamp.
+     * @return The current timestamp in ticks of the active source
+     */
+    static long long Now()
+    {
+        EnsureCalibrated();
+#if PROFILER_HAS_TSC
+        if (source_ == ClockSource::TSC)
+        {
+            return static_cast<long long>(__rdtsc());
+        }
+#endif
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Read the current timestamp once every previous instruction finished. Used to close scopes so the measured code
+     * can't leak past the read.
+     * @return The current timestamp in ticks of the active source
+     */
+    static long long NowOrdered()
+    {
+        EnsureCalibrated();
+#if PROFILER_HAS_TSC
+        if (source_ == ClockSource::TSC)
+        {
+            unsigned int processor;
+            return static_cast<long long>(__rdtscp(&processor));
+        }
+#endif
+        return Now();
+    }
+
+    /**
+     * Select the timestamp source and calibrate it, unless that already happened. Only the first call picks the
+     * source, timestamps taken since would change meaning otherwise.
+     * @param source The requested source, it falls back to ClockSource::STEADY if the CPU doesn't support it
+     */
+    static void Calibrate(const ClockSource source)
+    {
+        if (calibrated_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        std::lock_guard calibrationLock(calibrationMutex_);
+        if (calibrated_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        source_ = source == ClockSource::TSC && HasInvariantTsc() ? ClockSource::TSC : ClockSource::STEADY;
+#if PROFILER_HAS_TSC
+        if (source_ == ClockSource::TSC)
+        {
+            // Compare the counter against steady_clock over a short busy wait.
+            unsigned int processor;
+            const auto steadyStart = std::chrono::steady_clock::now();
+            const long long ticksStart = static_cast<long long>(__rdtscp(&processor));
+            auto steadyEnd = steadyStart;
+            while (steadyEnd - steadyStart < calibrationTime)
+            {
+                steadyEnd = std::chrono::steady_clock::now();
+            }
+            const long long ticksEnd = static_cast<long long>(__rdtscp(&processor));
+
+            const long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                steadyEnd - steadyStart).count();
+            ticksPerSecond_ = static_cast<uint64_t>(static_cast<double>(ticksEnd - ticksStart) * 1e9 /
+                                                    static_cast<double>(nanoseconds));
+        }
+#endif
+        calibrated_.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Get the active timestamp source.
+     * @return The source picked by the calibration
+     */
+    static ClockSource GetSource()
+    {
+        EnsureCalibrated();
+        return source_;
+    }
+
+    /**
+     * Get the calibration of the active source.
+     * @return Amount of ticks in one second
+     */
+    static uint64_t TicksPerSecond()
+    {
+        EnsureCalibrated();
+        return ticksPerSecond_;
+    }
+
+private:
+    static constexpr std::chrono::milliseconds calibrationTime{10}; /**< How long the calibration measures for. */
+
+    static inline ClockSource source_ = ClockSource::STEADY; /**< Source Now reads from. */
+    static inline uint64_t ticksPerSecond_ = 1'000'000'000; /**< Ticks per second of the source. */
+    static inline std::atomic<bool> calibrated_ = false; /**< Whether source_ and ticksPerSecond_ are set for good. */
+    static inline std::mutex calibrationMutex_; /**< Lock so only one thread calibrates. */
+
+    /**
+     * Calibrate the default source if nothing did yet, so timestamps taken before any session match the ticks per
+     * second they get written with.
+     */
+    static void EnsureCalibrated()
+    {
+        if (!calibrated_.load(std::memory_order_acquire)) [[unlikely]]
+        {
+            Calibrate(ClockSource::TSC);
+        }
+    }
+
+    /**
+     * Check whether the timestamp counter ticks at a constant rate across frequency changes and sleep states.
+     * @return Whether the counter can be used as a clock
+     */
+    static bool HasInvariantTsc()
+    {
+#if PROFILER_HAS_TSC
+#if defined(_MSC_VER)
+        int registers[4] = {};
+        __cpuid(registers, 0x80000000);
+        if (static_cast<unsigned int>(registers[0]) < 0x80000007)
+        {
+            return false;
+        }
+        __cpuid(registers, 0x80000007);
+        return (registers[3] & (1 << 8)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+        {
+            return false;
+        }
+        return (edx & (1u << 8)) != 0;
+#endif
+#else
+        return false;
+#endif
+    }
+};
+
+/**
+ * Static description of a place in the code that opens timer scopes. PROFILE_SCOPE_TIME creates one per call site so
+ * the name gets escaped once and each session writes it once, timer entries only refer to it by ID.
+ */
+class CallSite
+{
+public:
+    /**
+     * Describe a call site and give it a new ID.
+     * @param name Name of the scopes opened here
+     * @param file File of the call site
+     * @param line Line of the call site
+     */
+    CallSite(const char* name, const char* file, const uint32_t line)
+        : m_id_(nextId_.fetch_add(1, std::memory_order_relaxed)), m_line_(line)
+    {
+        // Call sites get built from inside the profiled code, their strings aren't part of it.
+        ProfileLock lock;
+        m_name_ = trace_format::EscapeJson(name);
+        m_file_ = trace_format::EscapeJson(file);
+    }
+
+    CallSite(const CallSite&) = delete;
+    CallSite& operator=(const CallSite&) = delete;
+
+    /**
+     * Get the ID of the call site, unique for the whole program.
+     * @return The ID of the call site
+     */
+    [[nodiscard]] uint32_t GetId() const
+    {
+        return m_id_;
+    }
+
+    /**
+     * Get the name of the scopes opened here.
+     * @return The name, already JSON escaped
+     */
+    [[nodiscard]] const std::string& GetName() const
+    {
+        return m_name_;
+    }
+
+    /**
+     * Get the file of the call site.
+     * @return The file, already JSON escaped
+     */
+    [[nodiscard]] const std::string& GetFile() const
+    {
+        return m_file_;
+    }
+
+    /**
+     * Get the line of the call site.
+     * @return The line in the file
+     */
+    [[nodiscard]] uint32_t GetLine() const
+    {
+        return m_line_;
+    }
+
+private:
+    uint32_t m_id_; /**< ID of the call site. */
+    uint32_t m_line_; /**< Line of the call site. */
+    std::string m_name_; /**< Escaped name of the scopes opened here. */
+    std::string m_file_; /**< Escaped file of the call site. */
+
+    static inline std::atomic<uint32_t> nextId_ = 0; /**< ID the next call site gets. */
+};
+
+/**
+ * Struct to store the result of a timer profiling
+ */
+struct ProfileResult_Time
+{
+    const CallSite* callSite; /**< Where the scope was opened. */
+    uint32_t threadId; /**< The thread of the function call being measured. */
+    long long start, end; /**< Time stamp of the profiling, in ProfileClock ticks */
+};
+
+/**
+ * Plain record of a closed timer scope. This is what producers hand over to the writer thread.
+ * @remark It must stay trivially copyable, nothing it points to may go away before the writer reads it.
+ */
+struct TimerRecord
+{
+    const CallSite* callSite; /**< Where the scope was opened. */
+    uint32_t threadId; /**< The thread of the function call being measured. */
+    long long start, end; /**< Time stamp of the profiling, in ProfileClock ticks */
+};
+
+/**
+ * Single-producer single-consumer queue of timer records, made of fixed size rings.
+ * The owning thread pushes when a scope closes and the writer thread pops, neither of them ever blocks the other. When
+ * the producer is allowed to grow the queue it links a ring twice as big, the consumer frees the old one once it's empty.
+ * @remark The queue only holds a weak reference to a token its owner keeps until it exits, so the writer can tell when
+ * the queue won't get any more records and free it once drained.
+ */
+class TimerRingBuffer // NOLINT(cppcoreguidelines-special-member-functions)
+{
+public:
+    /**
+     * Amount of records the first ring can hold. Must be a power of two.
+     */
+    static constexpr size_t capacity = 4096;
+
+    /**
+     * Create an empty queue.
+     * @param owner Thread that pushes into the queue
+     */
+    explicit TimerRingBuffer(const std::thread::id owner)
+        : m_owner_(owner), m_ownerAlive_(OwnerLifetime::Token()), m_producerRing_(new Ring(capacity)),
+          m_consumerRing_(m_producerRing_)
+    {
+    }
+
+    TimerRingBuffer(const TimerRingBuffer&) = delete;
+    TimerRingBuffer& operator=(const TimerRingBuffer&) = delete;
+
+    /**
+     * Free every ring.
+     */
+    ~TimerRingBuffer()
+    {
+        ProfileLock lock;
+        while (m_consumerRing_ != nullptr)
+        {
+            delete std::exchange(m_consumerRing_, m_consumerRing_->next.load(std::memory_order_relaxed));
+        }
+    }
+
+    /**
+     * Get the thread that pushes into the queue.
+     * @return Id of the owning thread, a default id once it exited so a new thread reusing the id doesn't pick it up
+     */
+    [[nodiscard]] std::thread::id GetOwner() const
+    {
+        return m_ownerAlive_.expired() ? std::thread::id{} : m_owner_;
+    }
+
+    /**
+     * Check whether the owning thread exited. Once this returned true every record it pushed can be popped.
+     * @return Whether the owner exited
+     */
+    [[nodiscard]] bool OwnerExited() const
+    {
+        const bool exited = m_ownerAlive_.expired();
+        // Pairs with the release of the token, the owner's last pushes happened before it.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return exited;
+    }
+
+    /**
+     * Check whether the calling thread is exiting and already released its token. Its queues may be freed at any
+     * moment from then on, so nothing may be pushed into them anymore.
+     * @return Whether the calling thread is exiting
+     */
+    static bool CallerExiting()
+    {
+        return OwnerLifetime::exiting;
+    }
+
+    /**
+     * Try to append a record. Only the owning thread may call this.
+     * @param record The record to append
+     * @return Whether there was space for the record
+     */
+    bool TryPush(const TimerRecord& record)
+    {
+        Ring& ring = *m_producerRing_;
+        const size_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == ring.capacity)
+        {
+            return false;
+        }
+
+        ring.records[head & (ring.capacity - 1)] = record;
+        ring.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Append a record, linking a ring twice as big if the current one is full. Only the owning thread may call this.
+     * @param record The record to append
+     */
+    void PushGrowing(const TimerRecord& record)
+    {
+        if (TryPush(record))
+        {
+            return;
+        }
+
+        ProfileLock lock;
+        Ring* bigger = new Ring(m_producerRing_->capacity * 2);
+        bigger->records[0] = record;
+        bigger->head.store(1, std::memory_order_relaxed);
+        // Published after the last record of the old ring, the consumer sees both once it sees the link.
+        m_producerRing_->next.store(bigger, std::memory_order_release);
+        m_producerRing_ = bigger;
+    }
+
+    /**
+     * Try to take the oldest record. Only the writer thread may call this.
+     * @param record Output parameter for the record
+     * @return Whether there was a record to take
+     */
+    bool TryPop(TimerRecord& record)
+    {
+        while (true)
+        {
+            Ring& ring = *m_consumerRing_;
+            const size_t tail = ring.tail.load(std::memory_order_relaxed);
+            if (tail != ring.head.load(std::memory_order_acquire))
+            {
+                record = ring.records[tail & (ring.capacity - 1)];
+                ring.tail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            Ring* next = ring.next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return false;
+            }
+            if (tail != ring.head.load(std::memory_order_acquire))
+            {
+                continue; // The producer pushed its last records into this ring just before linking the next one
+            }
+
+            ProfileLock lock;
+            delete m_consumerRing_;
+            m_consumerRing_ = next;
+        }
+    }
+
+private:
+    /**
+     * Token a thread keeps from creating its first queue until it exits.
+     */
+    struct OwnerLifetime // NOLINT(cppcoreguidelines-special-member-functions)
+    {
+        std::shared_ptr<char> token = std::make_shared<char>(); /**< Queues of the thread hold weak references to it. */
+
+        /**
+         * Release the token when the thread exits.
+         */
+        ~OwnerLifetime()
+        {
+            exiting = true;
+            ProfileLock lock;
+            token.reset();
+        }
+
+        /**
+         * Get the token of the calling thread, creating it the first time.
+         * @return The token
+         */
+        static const std::shared_ptr<char>& Token()
+        {
+            thread_local OwnerLifetime lifetime;
+            return lifetime.token;
+        }
+
+        static inline thread_local bool exiting = false; /**< Whether the thread's token got released. */
+    };
+
+    /**
+     * One ring of the queue.
+     */
+    struct Ring
+    {
+        /**
+         * Create an empty ring.
+         * @param capacity Amount of records it holds, a power of two
+         */
+        explicit Ring(const size_t capacity)
+            : capacity(capacity), records(new TimerRecord[capacity])
+        {
+        }
+
+        size_t capacity; /**< Amount of records the ring holds. */
+        std::unique_ptr<TimerRecord[]> records; /**< Storage of the ring. */
+        std::atomic<Ring*> next = nullptr; /**< Ring the producer moved on to once this one filled up. */
+        alignas(64) std::atomic<size_t> head = 0; /**< Next slot to write, only modified by the producer. */
+        alignas(64) std::atomic<size_t> tail = 0; /**< Next slot to read, only modified by the consumer. */
+    };
+
+    std::thread::id m_owner_; /**< Thread that pushes into the queue. */
+    std::weak_ptr<char> m_ownerAlive_; /**< Token of the owning thread, expires when it exits. */
+    Ring* m_producerRing_; /**< Ring the producer pushes into, the newest one. */
+    Ring* m_consumerRing_; /**< Ring the consumer pops from, the oldest one. */
+};
+
+/**
+ * Node of a calling-context tree, one per distinct path of timer scopes on a thread.
+ * Only the owning thread writes the statistics and links children, the atomics are there so the tree can be merged from
+ * another thread.
+ */
+struct CallTreeNode
+{
+    const CallSite* callSite = nullptr; /**< Scope of the node, nullptr for the root. */
+    CallTreeNode* parent = nullptr; /**< Enclosing scope, nullptr for the root. */
+    std::atomic<CallTreeNode*> firstChild = nullptr; /**< Most recently seen child scope. */
+    std::atomic<CallTreeNode*> nextSibling = nullptr; /**< Next child of the parent. */
+    std::atomic<uint64_t> calls = 0; /**< How many times the scope closed on this path. */
+    std::atomic<uint64_t> totalTicks = 0; /**< Time spent in the scope, in ProfileClock ticks. */
+    std::atomic<uint64_t> childTicks = 0; /**< Part of the total spent in child scopes. */
+    std::atomic<uint64_t> minTicks = UINT64_MAX; /**< Shortest call. */
+    std::atomic<uint64_t> maxTicks = 0; /**< Longest call. */
+};
+
+/**
+ * Calling-context tree of the timer scopes of one thread, used by TimerMode::CALL_TREE.
+ * Entering a scope looks its call site up among the children of the current node and exiting one only bumps counters,
+ * nothing is written until the session ends.
+ */
+class CallTree // NOLINT(cppcoreguidelines-special-member-functions)
+{
+public:
+    /**
+     * Create an empty tree.
+     * @param owner Thread whose scopes go into the tree
+     */
+    explicit CallTree(const std::thread::id owner)
+        : m_owner_(owner), m_current_(&m_root_)
+    {
+    }
+
+    CallTree(const CallTree&) = delete;
+    CallTree& operator=(const CallTree&) = delete;
+
+    /**
+     * Free every node.
+     */
+    ~CallTree()
+    {
+        Free(m_root_.firstChild.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Get the thread whose scopes go into the tree.
+     * @return Id of the owning thread
+     */
+    [[nodiscard]] std::thread::id GetOwner() const
+    {
+        return m_owner_;
+    }
+
+    /**
+     * Get the root of the tree. It stands for the thread and has no call site.
+     * @return The root node
+     */
+    [[nodiscard]] const CallTreeNode& GetRoot() const
+    {
+        return m_root_;
+    }
+
+    /**
+     * Enter a scope below the current one. Only the owning thread may call this.
+     * @param callSite Call site of the scope
+     * @return The node of the scope, to hand back to Exit
+     */
+    CallTreeNode* Enter(const CallSite& callSite)
+    {
+        CallTreeNode* node = m_current_->firstChild.load(std::memory_order_relaxed);
+        while (node != nullptr && node->callSite != &callSite)
+        {
+            node = node->nextSibling.load(std::memory_order_relaxed);
+        }
+
+        if (node == nullptr)
+        {
+            // Nodes are created once per path, not per call.
+            ProfileLock lock;
+            node = new CallTreeNode;
+            node->callSite = &callSite;
+            node->parent = m_current_;
+            node->nextSibling.store(m_current_->firstChild.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_current_->firstChild.store(node, std::memory_order_release);
+        }
+
+        m_current_ = node;
+        return node;
+    }
+
+    /**
+     * Exit a scope and add the call to its node. Only the owning thread may call this.
+     * @remark Scopes normally close innermost first. One that closes before the scopes it opened pops them too, and one
+     * that closes after its enclosing scope already did leaves the current path alone.
+     * @param node Node returned by Enter
+     * @param duration How long the call took, in ProfileClock ticks
+     */
+    void Exit(CallTreeNode* node, const uint64_t duration)
+    {
+        Add(node->calls, 1);
+        Add(node->totalTicks, duration);
+        if (duration < node->minTicks.load(std::memory_order_relaxed))
+            node->minTicks.store(duration, std::memory_order_relaxed);
+        if (duration > node->maxTicks.load(std::memory_order_relaxed))
+            node->maxTicks.store(duration, std::memory_order_relaxed);
+        Add(node->parent->childTicks, duration);
+        for (const CallTreeNode* open = m_current_; open != nullptr; open = open->parent)
+        {
+            if (open == node)
+            {
+                m_current_ = node->parent;
+                break;
+            }
+        }
+    }
+
+    /**
+     * Clear the statistics of every node for a new session. The nodes are kept, running scopes may point to them.
+     */
+    void Reset()
+    {
+        Reset(&m_root_);
+    }
+
+private:
+    /**
+     * Add to a counter only the owning thread writes. No read-modify-write needed as nobody else writes it.
+     * @param counter Counter to bump
+     * @param amount Amount to add
+     */
+    static void Add(std::atomic<uint64_t>& counter, const uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * Clear the statistics of a node and everything below it.
+     * @param node The node
+     */
+    static void Reset(CallTreeNode* node)
+    {
+        node->calls.store(0, std::memory_order_relaxed);
+        node->totalTicks.store(0, std::memory_order_relaxed);
+        node->childTicks.store(0, std::memory_order_relaxed);
+        node->minTicks.store(UINT64_MAX, std::memory_order_relaxed);
+        node->maxTicks.store(0, std::memory_order_relaxed);
+        for (CallTreeNode* child = node->firstChild.load(std::memory_order_acquire); child != nullptr;
+             child = child->nextSibling.load(std::memory_order_relaxed))
+        {
+            Reset(child);
+        }
+    }
+
+    /**
+     * Free a node, its siblings after it and everything below them.
+     * @param node The first node to free
+     */
+    static void Free(CallTreeNode* node)
+    {
+        while (node != nullptr)
+        {
+            CallTreeNode* next = node->nextSibling.load(std::memory_order_relaxed);
+            Free(node->firstChild.load(std::memory_order_relaxed));
+            delete node;
+            node = next;
+        }
+    }
+
+    std::thread::id m_owner_; /**< Thread whose scopes go into the tree. */
+    CallTreeNode m_root_; /**< Root standing for the whole thread. */
+    CallTreeNode* m_current_; /**< Innermost scope the thread is in. */
+};
+
+/**
+ * How an InstrumentationMemory records allocations.
+ */
+enum class MemoryProfileMode : uint8_t
+{
+    FULL, /**< Every allocation gets recorded with its stack. */
+    SAMPLED,
+    /**< Allocations are sampled with a probability proportional to their size, see ShouldSample. Only the totals count
+     * every allocation, timer scopes and published events only get the sampled ones. */
+    AGGREGATE,
+    /**< Only counters and size histograms are kept, memory use doesn't grow with the amount of allocations. The peak is
+     * written but not what was live at it. */
+    STREAMING
+    /**< Allocation and deallocation events are written as they happen and only live allocations are kept in memory. */
+};
+
+/**
+ * What the Instrumentor keeps of closed timer scopes.
+ */
+enum class TimerMode : uint8_t
+{
+    EVENTS, /**< Every scope is written with its start and duration. */
+    CALL_TREE /**< Scopes are added up in a calling-context tree per thread, merged and written when the session ends. */
+};
+
+/**
+ * When the Instrumentor moves the buffered trace into the results file.
+ */
+enum class FlushPolicy : uint8_t
+{
+    EVERY_N_BYTES, /**< Write the buffer once it holds at least the threshold amount of bytes. */
+    EVERY_T_MILLISECONDS, /**< Write the buffer once the threshold amount of milliseconds passed since the last write. */
+    SESSION_END /**< Keep the whole trace in memory and write it when the session ends. */
+};
+
+/**
+ * What producers do when the buffer they format into is full and the writer thread is still busy with the other one.
+ */
+enum class BackpressurePolicy : uint8_t
+{
+    BLOCK, /**< Wait until the writer thread is done with the other buffer. */
+    DROP, /**< Throw the entry away and count it, the count is written at the end of the trace. */
+    GROW /**< Keep growing the buffer past its limit. */
+};
+
+/**
+ * Growable in-memory stream buffer the trace gets formatted into.
+ * Writing to it never reaches the file system, the Instrumentor moves its contents to the results file when its
+ * FlushPolicy says so.
+ */
+class TraceBuffer final : public std::streambuf
+{
+public:
+    /**
+     * Capacity the buffer starts with.
+     */
+    static constexpr size_t initialCapacity = 64 * 1024;
+
+    /**
+     * Amount of bytes waiting to be written.
+     * @return The amount of bytes in the buffer
+     */
+    [[nodiscard]] size_t Size() const
+    {
+        return static_cast<size_t>(pptr() - pbase());
+    }
+
+    /**
+     * Make sure the buffer can hold a given amount of bytes without growing.
+     * @param capacity The amount of bytes to hold
+     */
+    void Reserve(const size_t capacity)
+    {
+        if (capacity > m_storage_.size())
+        {
+            Grow(capacity);
+        }
+    }
+
+    /**
+     * Write the buffered bytes into a stream and empty the buffer.
+     * @param output The stream to write into
+     */
+    void WriteTo(std::ostream& output)
+    {
+        output.write(pbase(), static_cast<std::streamsize>(Size()));
+        output.flush();
+        setp(pbase(), epptr());
+    }
+
+protected:
+    int_type overflow(const int_type character) override
+    {
+        if (traits_type::eq_int_type(character, traits_type::eof()))
+        {
+            return traits_type::not_eof(character);
+        }
+
+        // Storage is only allocated on the first write, the Instrumentor gets built from inside operator new.
+        Grow(std::max(m_storage_.size() * 2, initialCapacity));
+        *pptr() = traits_type::to_char_type(character);
+        pbump(1);
+        return character;
+    }
+
+    std::streamsize xsputn(const char* data, const std::streamsize count) override
+    {
+        const size_t size = static_cast<size_t>(count);
+        if (size > static_cast<size_t>(epptr() - pptr()))
+        {
+            Grow(std::max({m_storage_.size() * 2, Size() + size, initialCapacity}));
+        }
+
+        std::memcpy(pptr(), data, size);
+        Advance(size);
+        return count;
+    }
+
+private:
+    std::vector<char> m_storage_; /**< Backing storage, the put area always spans all of it. */
+
+    /**
+     * Resize the storage keeping the buffered bytes.
+     * @param capacity The new capacity of the buffer
+     */
+    void Grow(const size_t capacity)
+    {
+        const size_t size = Size();
+        m_storage_.resize(capacity);
+        setp(m_storage_.data(), m_storage_.data() + m_storage_.size());
+        Advance(size);
+    }
+
+    /**
+     * Move the put pointer forward. pbump only takes an int so big amounts go in steps.
+     * @param count Amount of bytes to move
+     */
+    void Advance(size_t count)
+    {
+        while (count > INT_MAX)
+        {
+            pbump(INT_MAX);
+            count -= INT_MAX;
+        }
+        pbump(static_cast<int>(count));
+    }
+};
+
+/**
+ * Get how many bytes the allocator actually reserved for a block.
+ * @remark Memory profilers count every block with this size, both when it's allocated and when it's released, since
+ * most deallocations don't come with a size.
+ * @param block Pointer returned by malloc or AlignedAllocate
+ * @param alignment Alignment the block was allocated with, 0 if it came from malloc
+ * @return Usable size of the block
+ */
+inline size_t AllocationSize(void* block, [[maybe_unused]] const size_t alignment = 0)
+{
+#if defined(_MSC_VER)
+    return alignment == 0 ? _msize(block) : _aligned_msize(block, alignment, 0);
+#elif defined(__APPLE__)
+    return malloc_size(block);
+#else
+    return malloc_usable_size(block);
+#endif
+}
+
+/**
+ * Allocate a block with an alignment stricter than the one malloc guarantees.
+ * @param size Size of the block
+ * @param alignment Alignment of the block, a power of two
+ * @return The block, nullptr if it couldn't be allocated. It must be released with AlignedFree
+ */
+inline void* AlignedAllocate(const size_t size, const size_t alignment)
+{
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, alignment);
+#else
+    void* block = nullptr;
+    return posix_memalign(&block, std::max(alignment, sizeof(void*)), size) == 0 ? block : nullptr;
+#endif
+}
+
+/**
+ * Release a block allocated with AlignedAllocate.
+ * @param block The block to release
+ */
+inline void AlignedFree(void* block)
+{
+#if defined(_MSC_VER)
+    _aligned_free(block);
+#else
+    std::free(block);
+#endif
+}
+
+/**
+ * Struct to store the result of a memory profiling
+ */
+struct ProfileResult_Memory
+{
+    /**
+     * Maximum amount of frames kept per allocation. Deeper stacks get truncated.
+     */
+    static constexpr size_t maxStackDepth = 32;
+
+    bool isArray; /**< Whether the memory allocation was for an array or not. */
+    uint32_t threadId; /**< The thread that allocated the memory. */
+    void* location; /**< Pointer to the location that memory is being allocated to. */
+    size_t size; /**< How much memory was allocated. */
+    uint8_t stackDepth; /**< How many entries of stackFrames are valid. */
+    std::array<std::stacktrace_entry, maxStackDepth> stackFrames;
+    /**< Raw frames of where the memory was allocated in code. They only get symbolized when written. */
+    long long start, end = -1; /**< Time stamp of the profiling, in ProfileClock ticks. end is -1 until deallocated */
+    double sampleWeight = 1.0;
+    /**< How many allocations of this size this record stands for. Always 1 unless the profiler is sampling. */
+    const CallSite* scope = nullptr; /**< Innermost timer scope open when allocated, nullptr outside of any. */
+};
+
+/**
+ * Allocations made inside one timer scope.
+ */
+struct ProfileResult_ScopeSummary
+{
+    const CallSite* callSite = nullptr; /**< Call site of the timer scope. */
+    uint64_t allocations = 0; /**< How many allocations happened while it was the innermost scope. */
+    uint64_t bytesAllocated = 0; /**< Bytes allocated while it was the innermost scope. */
+};
+
+/**
+ * Struct to store the summary of an aggregate memory profiling
+ */
+struct ProfileResult_MemorySummary
+{
+    /**
+     * Amount of log2 size classes in the histograms. Bucket i holds sizes with a bit width of i.
+     */
+    static constexpr size_t histogramBuckets = 64;
+
+    std::string name; /**< Name of the memory profiler. */
+    uint64_t allocations = 0; /**< How many allocations happened. */
+    uint64_t deallocations = 0; /**< How many deallocations happened. */
+    uint64_t bytesAllocated = 0; /**< Total bytes allocated. */
+    uint64_t bytesDeallocated = 0; /**< Total bytes deallocated. */
+    uint64_t peakBytes = 0; /**< Highest amount of live bytes seen. */
+    std::array<uint64_t, histogramBuckets> allocationHistogram = {}; /**< Allocations per log2 size class. */
+    std::array<uint64_t, histogramBuckets> deallocationHistogram = {}; /**< Deallocations per log2 size class. */
+    std::vector<ProfileResult_ScopeSummary> scopes; /**< Allocations per timer scope, by call site ID. */
+
+    /**
+     * Get the bytes still allocated when the profiler stopped.
+     * @return Live bytes, negative if memory allocated before the profiler started got freed.
+     */
+    long long LiveBytes() const
+    {
+        return static_cast<long long>(bytesAllocated) - static_cast<long long>(bytesDeallocated);
+    }
+};
+
+/**
+ * Allocations of one call site that were live at the peak of a memory profiler.
+ */
+struct ProfileResult_PeakSite
+{
+    ProfileResult_Memory allocation; /**< One allocation of the call site, its stack identifies the site. */
+    uint64_t bytes = 0; /**< Usable bytes the call site had live at the peak, estimated for sampled profilers. */
+    uint64_t count = 0; /**< Allocations the call site had live at the peak. */
+};
+
+/**
+ * What was live when a memory profiler reached its highest peak. The sites add up to liveBytes, except for sampled
+ * profilers whose sites are estimated from the sampled blocks. Aggregate profilers don't keep call sites and write none.
+ */
+struct ProfileResult_PeakSnapshot
+{
+    std::string name; /**< Name of the memory profiler. */
+    long long timestamp = 0; /**< When the peak was reached, in ProfileClock ticks. */
+    uint64_t liveBytes = 0; /**< Live bytes at the peak. */
+    std::vector<ProfileResult_PeakSite> sites; /**< Live allocations grouped by call site, biggest first. */
+};
+
+/**
+ * Struct to store one frame of a program marking its frames with Instrumentor::MarkFrame.
+ */
+struct ProfileResult_Frame
+{
+    uint64_t number = 0; /**< Number of the frame, the first one is 1. */
+    long long start = 0; /**< Mark that started the frame, in ProfileClock ticks. */
+    long long end = 0; /**< Mark that ended the frame, in ProfileClock ticks. */
+    uint64_t allocations = 0; /**< Allocations made during the frame. */
+    uint64_t bytesAllocated = 0; /**< Bytes allocated during the frame. */
+};
+
+/**
+ * Struct related to the instrumentation session. Right now it only stores the name of the session.
+ */
+struct InstrumentationSession
+{
+    std::string name;
+};
+
+/**
+ * Class to manage profiling sessions. Every instance tracks one session at a time and owns its output file, buffers and
+ * writer thread. Get() is the default instance, threads can be bound to another one to route their events there.
+ * @remark Unbind threads and stop the memory profilers of an instance before destroying it.
+ */
+class Instrumentor
+{
+private:
+    InstrumentationSession* m_currentSession_; /**< The current instrumentation session going on. */
+    std::ofstream m_outputFile_; /**< handler of the file to write the results into. */
+    std::array<TraceBuffer, 2> m_outputBuffers_;
+    /**< Producers format into the front buffer while the writer thread writes the back one into the file. */
+    size_t m_frontBuffer_ = 0; /**< Index of the front buffer. */
+    bool m_backBufferPending_ = false; /**< Whether the back buffer still has to be written into the file. */
+    std::condition_variable m_backBufferWritten_; /**< Notified every time the back buffer gets written. */
+    bool m_writerActive_ = false; /**< Whether the writer thread will still write the back buffer. */
+    std::ostream m_outputStream_{&m_outputBuffers_[0]}; /**< Formatting stream on top of the front buffer. */
+    FlushPolicy m_flushPolicy_ = FlushPolicy::EVERY_N_BYTES; /**< When the front buffer gets handed to the writer. */
+    size_t m_flushThreshold_ = TraceBuffer::initialCapacity; /**< Bytes or milliseconds, depending on the policy. */
+    std::chrono::steady_clock::time_point m_lastFlush_; /**< Last time the front buffer got handed to the writer. */
+    BackpressurePolicy m_backpressurePolicy_ = BackpressurePolicy::GROW; /**< What to do when the front buffer is full. */
+    size_t m_bufferLimit_ = defaultBufferLimit; /**< Size the front buffer is considered full at. */
+    std::atomic<uint64_t> m_droppedEntries_ = 0; /**< Entries thrown away by BackpressurePolicy::DROP this session. */
+    std::mutex m_outputMutex_; /**< Lock for the output stream, the writer thread and the memory profilers share it. */
+    int m_profileCount_mem_; /**< Counter of how many entries have been in the memory profiling */
+    int m_profileCount_time_; /**< Counter of how many entries have been in the time profiling */
+
+    TraceFormat m_format_ = TraceFormat::JSON; /**< Format of the current session output. */
+    std::unordered_map<std::string, uint32_t> m_stringIds_; /**< Strings already written to a binary trace. */
+    std::map<std::vector<uint32_t>, uint32_t> m_stackIds_; /**< Unique stacks of the session, by frame IDs. */
+    std::unordered_map<std::stacktrace_entry, uint32_t> m_frameIds_;
+    /**< Unique frames of the session. They get symbolized once, when the session ends. */
+    std::vector<uint32_t> m_stackScratch_; /**< Reused buffer to build the frame IDs of a stack without allocating. */
+    long long m_lastTimestamp_ = 0; /**< Previous timestamp written to a binary trace, used for delta encoding. */
+    std::vector<ProfileResult_MemorySummary> m_memorySummaries_; /**< Summaries to write in the JSON footer. */
+    std::vector<std::string> m_peakSnapshots_; /**< Peak snapshots to write in the JSON footer, already formatted. */
+    std::vector<const CallSite*> m_sessionCallSites_; /**< Call sites used this session by ID, nullptr if unused. */
+    std::unordered_map<std::string, std::unique_ptr<CallSite>> m_namedCallSites_;
+    /**< Call sites standing in for timers created with a plain name. Kept across sessions like static call sites. */
+    std::mutex m_namedCallSitesMutex_; /**< Lock for the named call sites. */
+
+    std::vector<std::unique_ptr<TimerRingBuffer>> m_timerBuffers_;
+    /**< One ring per running thread that closed a timer, plus the ones of exited threads until they're drained. */
+    std::mutex m_timerBuffersMutex_; /**< Lock for registering new rings and call trees, the hot path never takes it. */
+    std::atomic<TimerMode> m_timerMode_ = TimerMode::EVENTS; /**< What is kept of closed timer scopes. */
+    std::vector<std::unique_ptr<CallTree>> m_callTrees_; /**< One tree per thread that ever entered a timer scope. */
+    std::vector<class InstrumentationMemory*> m_memoryProfilers_;
+    /**< Running memory profilers writing into this instrumentor, the writer thread watches their peaks. */
+    std::mutex m_memoryProfilersMutex_; /**< Lock for the running memory profilers. */
+    std::mutex m_frameMutex_; /**< Lock for the frame marks, frames may be marked from any thread. */
+    ProfileResult_Frame m_currentFrame_; /**< Frame started by the last mark, its number is 0 before the first one. */
+    const class InstrumentationMemory* m_frameMemory_ = nullptr; /**< Memory profiler the current frame counts with. */
+    std::thread m_writerThread_; /**< Background thread draining the timer rings into the output stream. */
+    std::atomic<bool> m_sessionRunning_ = false; /**< Whether producers should hand records over. */
+    std::mutex m_writerWakeMutex_; /**< Mutex paired with the wake condition. */
+    std::condition_variable m_writerWake_; /**< Used to wake the writer early when a ring is full or the session ends. */
+    std::mutex m_timerSpaceMutex_; /**< Mutex paired with the timer space condition. */
+    std::condition_variable m_timerSpaceFreed_; /**< Used to wake producers waiting for room in their ring. */
+
+    uint64_t m_id_; /**< Unique id of this instrumentor, used to tell thread_local caches apart. */
+
+    static inline std::atomic<uint64_t> nextId_ = 1; /**< Source of unique ids for instrumentors. */
+    static inline std::atomic<class InstrumentationMemory*> rootMemory_ = nullptr;
+    /**< Oldest running memory profiler, it gets the allocations of threads without a profiler of their own. Atomic
+     * because every allocating thread reads it, static so reading it never constructs the default instrumentor. */
+    static inline thread_local const Instrumentor* writerOf_ = nullptr;
+    /**< Instrumentor whose writer thread the calling thread is, nullptr for any other thread. */
+    static inline thread_local Instrumentor* threadInstrumentor_ = nullptr;
+    /**< Instrumentor the calling thread is bound to, nullptr to use the default one. */
+
+    /**
+     * Body of the writer thread. It wakes up periodically, drains every ring into the front buffer and writes the back
+     * buffer into the file until the session ends. The file is only touched from here while the session runs.
+     */
+    void WriterLoop()
+    {
+        // Nothing the writer allocates is part of the profiled program.
+        ProfileLock lock;
+        writerOf_ = this;
+        bool running = true;
+        while (running)
+        {
+            // One last pass after the session stops so nothing handed over is left behind.
+            running = m_sessionRunning_.load(std::memory_order_acquire);
+            DrainTimerBuffers();
+            ObserveMemoryPeaks();
+
+            size_t backBuffer;
+            {
+                // A timed policy has to flush even when nothing new is being written.
+                std::lock_guard outputLock(m_outputMutex_);
+                FlushIfDue();
+                backBuffer = m_backBufferPending_ ? m_frontBuffer_ ^ 1 : m_outputBuffers_.size();
+            }
+
+            if (backBuffer < m_outputBuffers_.size())
+            {
+                // Producers never touch the back buffer until the pending flag is cleared, so no lock is needed here.
+                m_outputBuffers_[backBuffer].WriteTo(m_outputFile_);
+                {
+                    std::lock_guard outputLock(m_outputMutex_);
+                    m_backBufferPending_ = false;
+                }
+                m_backBufferWritten_.notify_all();
+            }
+
+            if (running)
+            {
+                std::unique_lock wakeLock(m_writerWakeMutex_);
+                m_writerWake_.wait_for(wakeLock, std::chrono::milliseconds(2));
+            }
+        }
+
+        {
+            std::lock_guard outputLock(m_outputMutex_);
+            m_writerActive_ = false;
+        }
+        m_backBufferWritten_.notify_all();
+    }
+
+    /**
+     * Move every pending timer record from the rings into the output stream. Rings of threads that exited get freed
+     * once drained.
+     */
+    void DrainTimerBuffers()
+    {
+        std::lock_guard buffersLock(m_timerBuffersMutex_);
+        TimerRecord record;
+        for (auto& buffer : m_timerBuffers_)
+        {
+            // Checked before draining so that everything the thread pushed before exiting gets popped below.
+            const bool ownerExited = buffer->OwnerExited();
+            while (buffer->TryPop(record))
+            {
+                WriteProfile(ProfileResult_Time{record.callSite, record.threadId, record.start, record.end});
+            }
+
+            if (ownerExited)
+            {
+                ProfileLock lock;
+                buffer.reset();
+            }
+        }
+        std::erase(m_timerBuffers_, nullptr);
+        m_timerSpaceFreed_.notify_all();
+    }
+
+    /**
+     * Mark a call site as used in this session. Binary traces write it the first time. The output lock must be held.
+     * @param callSite The call site being used
+     */
+    void UseCallSite(const CallSite& callSite)
+    {
+        if (callSite.GetId() >= m_sessionCallSites_.size())
+        {
+            m_sessionCallSites_.resize(callSite.GetId() + 1, nullptr);
+        }
+        if (m_sessionCallSites_[callSite.GetId()] != nullptr)
+        {
+            return;
+        }
+        m_sessionCallSites_[callSite.GetId()] = &callSite;
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t nameId = InternString(callSite.GetName());
+            const uint32_t fileId = InternString(callSite.GetFile());
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::CALLSITE));
+            trace_format::WriteVarint(m_outputStream_, callSite.GetId());
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            trace_format::WriteVarint(m_outputStream_, fileId);
+            trace_format::WriteVarint(m_outputStream_, callSite.GetLine());
+        }
+    }
+
+    /**
+     * Get how binary memory records refer to a timer scope.
+     * @param scope Call site of the innermost timer scope when the memory was allocated, nullptr outside of any
+     * @return The call site id + 1, 0 outside of any scope
+     */
+    static uint64_t ScopeReference(const CallSite* scope)
+    {
+        return scope != nullptr ? scope->GetId() + 1ull : 0;
+    }
+
+    /**
+     * Write the timer scope of a JSON memory entry, nothing if it was made outside of any.
+     * @remark Expects the output lock to be held.
+     * @param scope Call site of the innermost timer scope when the memory was allocated
+     */
+    void WriteScope(const CallSite* scope)
+    {
+        if (scope == nullptr)
+            return;
+
+        UseCallSite(*scope);
+        m_outputStream_ << "\"sid\":" << scope->GetId() << ",";
+    }
+
+    /**
+     * Write the table of call sites used in the session, timer and memory entries refer to it by sid.
+     * @remark Expects the output lock to be held.
+     */
+    void WriteCallSites()
+    {
+        m_outputStream_ << "\"callSites\":[";
+        bool first = true;
+        for (const CallSite* callSite : m_sessionCallSites_)
+        {
+            if (callSite == nullptr)
+                continue;
+
+            m_outputStream_ << (first ? "{" : ",{");
+            m_outputStream_ << "\"id\":" << callSite->GetId() << ",";
+            m_outputStream_ << "\"name\":\"" << callSite->GetName() << "\",";
+            m_outputStream_ << "\"file\":\"" << callSite->GetFile() << "\",";
+            m_outputStream_ << "\"line\":" << callSite->GetLine();
+            m_outputStream_ << "}";
+            first = false;
+        }
+        m_outputStream_ << "]";
+    }
+
+    /**
+     * Swap the buffers so the writer thread writes what was formatted so far. The output lock must be held and the back
+     * buffer must be free.
+     */
+    void HandOffFrontBuffer()
+    {
+        m_frontBuffer_ ^= 1;
+        m_outputStream_.rdbuf(&m_outputBuffers_[m_frontBuffer_]);
+        m_backBufferPending_ = true;
+        m_lastFlush_ = std::chrono::steady_clock::now();
+        m_writerWake_.notify_one();
+    }
+
+    /**
+     * Write the back buffer from the calling thread. Only used when the writer thread can't do it: either the writer
+     * itself is the one waiting for it or the writer already exited. The output lock must be held.
+     */
+    void WriteBackBuffer()
+    {
+        m_outputBuffers_[m_frontBuffer_ ^ 1].WriteTo(m_outputFile_);
+        m_backBufferPending_ = false;
+    }
+
+    /**
+     * Hand the front buffer to the writer thread if the flush policy asks for it. If the writer is still busy with the
+     * back buffer it gets handed over on a later call. The output lock must be held.
+     */
+    void FlushIfDue()
+    {
+        if (m_backBufferPending_)
+        {
+            return;
+        }
+
+        const size_t size = m_outputBuffers_[m_frontBuffer_].Size();
+        switch (m_flushPolicy_)
+        {
+        case FlushPolicy::EVERY_N_BYTES:
+            if (size >= m_flushThreshold_)
+            {
+                HandOffFrontBuffer();
+            }
+            break;
+        case FlushPolicy::EVERY_T_MILLISECONDS:
+            if (size > 0 &&
+                std::chrono::steady_clock::now() - m_lastFlush_ >= std::chrono::milliseconds(m_flushThreshold_))
+            {
+                HandOffFrontBuffer();
+            }
+            break;
+        case FlushPolicy::SESSION_END:
+            break;
+        }
+    }
+
+    /**
+     * Make room in the front buffer for a new entry following the backpressure policy.
+     * @param outputLock The held output lock, BackpressurePolicy::BLOCK releases it while waiting
+     * @return Whether the entry can be written, false if it has to be dropped
+     */
+    bool ReserveSpace(std::unique_lock<std::mutex>& outputLock)
+    {
+        if (m_backpressurePolicy_ == BackpressurePolicy::GROW || m_outputBuffers_[m_frontBuffer_].Size() < m_bufferLimit_)
+        {
+            return true;
+        }
+
+        if (m_backBufferPending_ && (writerOf_ == this || !m_writerActive_))
+        {
+            // Nobody else is going to write it.
+            WriteBackBuffer();
+        }
+        else if (m_backBufferPending_ && m_backpressurePolicy_ == BackpressurePolicy::DROP)
+        {
+            m_droppedEntries_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else if (m_backBufferPending_)
+        {
+            m_backBufferWritten_.wait(outputLock, [this] { return !m_backBufferPending_ || !m_writerActive_; });
+            if (m_backBufferPending_)
+            {
+                WriteBackBuffer();
+            }
+        }
+
+        HandOffFrontBuffer();
+        return true;
+    }
+
+    /**
+     * Let every running memory profiler of this instrumentor check whether it reached a new peak.
+     */
+    void ObserveMemoryPeaks();
+
+    /**
+     * Get the ring of the calling thread, creating and registering it the first time.
+     * @return Reference to the ring owned by the calling thread
+     */
+    TimerRingBuffer& GetThreadTimerBuffer()
+    {
+        return GetThreadEntry(m_id_, m_timerBuffers_, m_timerBuffersMutex_, &TimerRingBuffer::GetOwner);
+    }
+
+    /**
+     * Get the call tree of the calling thread, creating and registering it the first time.
+     * @return Reference to the tree owned by the calling thread
+     */
+    CallTree& GetThreadCallTree()
+    {
+        return GetThreadEntry(m_id_, m_callTrees_, m_timerBuffersMutex_, &CallTree::GetOwner);
+    }
+
+    /**
+     * Node of the call trees of every thread added together.
+     */
+    struct MergedCallTreeNode
+    {
+        const CallSite* callSite = nullptr; /**< Scope of the node, nullptr for the root. */
+        uint64_t calls = 0; /**< How many times the scope closed on this path. */
+        uint64_t totalTicks = 0; /**< Time spent in the scope. */
+        uint64_t childTicks = 0; /**< Part of the total spent in child scopes. */
+        uint64_t minTicks = UINT64_MAX; /**< Shortest call. */
+        uint64_t maxTicks = 0; /**< Longest call. */
+        std::map<uint32_t, MergedCallTreeNode> children; /**< Child scopes by call site ID. */
+    };
+
+    /**
+     * Add a node of a thread's tree, and everything below it, into the merged tree.
+     * @param node Node of the thread's tree
+     * @param merged Node of the merged tree at the same path
+     */
+    static void MergeCallTree(const CallTreeNode& node, MergedCallTreeNode& merged)
+    {
+        merged.calls += node.calls.load(std::memory_order_relaxed);
+        merged.totalTicks += node.totalTicks.load(std::memory_order_relaxed);
+        merged.childTicks += node.childTicks.load(std::memory_order_relaxed);
+        merged.minTicks = std::min(merged.minTicks, node.minTicks.load(std::memory_order_relaxed));
+        merged.maxTicks = std::max(merged.maxTicks, node.maxTicks.load(std::memory_order_relaxed));
+        for (const CallTreeNode* child = node.firstChild.load(std::memory_order_acquire); child != nullptr;
+             child = child->nextSibling.load(std::memory_order_relaxed))
+        {
+            MergedCallTreeNode& mergedChild = merged.children[child->callSite->GetId()];
+            mergedChild.callSite = child->callSite;
+            MergeCallTree(*child, mergedChild);
+        }
+    }
+
+    /**
+     * Write the children of a merged node, depth first. Nodes are numbered in the order they are written starting at 1,
+     * the root is 0.
+     * @remark Expects the output lock to be held.
+     * @param node The merged node
+     * @param nodeId Number of the node
+     * @param nextId Number the next written node gets
+     */
+    void WriteCallTreeChildren(const MergedCallTreeNode& node, const uint32_t nodeId, uint32_t& nextId)
+    {
+        for (const MergedCallTreeNode& child : node.children | std::views::values)
+        {
+            const uint32_t childId = nextId++;
+            const uint64_t selfTicks = child.totalTicks > child.childTicks ? child.totalTicks - child.childTicks : 0;
+            const uint64_t minTicks = child.calls > 0 ? child.minTicks : 0;
+            UseCallSite(*child.callSite);
+
+            if (m_format_ == TraceFormat::BINARY)
+            {
+                m_outputStream_.put(static_cast<char>(trace_format::RECORD::CALL_TREE));
+                trace_format::WriteVarint(m_outputStream_, nodeId);
+                trace_format::WriteVarint(m_outputStream_, child.callSite->GetId());
+                trace_format::WriteVarint(m_outputStream_, child.calls);
+                trace_format::WriteVarint(m_outputStream_, child.totalTicks);
+                trace_format::WriteVarint(m_outputStream_, selfTicks);
+                trace_format::WriteVarint(m_outputStream_, minTicks);
+                trace_format::WriteVarint(m_outputStream_, child.maxTicks);
+            }
+            else
+            {
+                m_outputStream_ << (childId > 1 ? ",{" : "{");
+                m_outputStream_ << "\"id\":" << childId << ",";
+                m_outputStream_ << "\"parent\":" << nodeId << ",";
+                m_outputStream_ << "\"sid\":" << child.callSite->GetId() << ",";
+                m_outputStream_ << "\"name\":\"" << child.callSite->GetName() << "\",";
+                m_outputStream_ << "\"calls\":" << child.calls << ",";
+                m_outputStream_ << "\"total\":";
+                WriteTime(static_cast<long long>(child.totalTicks));
+                m_outputStream_ << ",\"self\":";
+                WriteTime(static_cast<long long>(selfTicks));
+                m_outputStream_ << ",\"min\":";
+                WriteTime(static_cast<long long>(minTicks));
+                m_outputStream_ << ",\"max\":";
+                WriteTime(static_cast<long long>(child.maxTicks));
+                m_outputStream_ << "}";
+            }
+
+            WriteCallTreeChildren(child, childId, nextId);
+        }
+    }
+
+    /**
+     * Merge the call trees of every thread.
+     * @remark Takes the timer buffers lock, so it must not be called with the output lock held. DrainTimerBuffers takes
+     * them in that order.
+     * @return Root of the merged tree
+     */
+    MergedCallTreeNode MergeCallTrees()
+    {
+        ProfileLock lock;
+        MergedCallTreeNode root;
+        std::lock_guard buffersLock(m_timerBuffersMutex_);
+        for (const auto& tree : m_callTrees_)
+        {
+            MergeCallTree(tree->GetRoot(), root);
+        }
+        return root;
+    }
+
+    /**
+     * Write a merged call tree. JSON traces get the whole tree as a flat array of nodes referring to their parent,
+     * binary traces one CALL_TREE record per node.
+     * @remark Expects the output lock to be held.
+     * @param root Root of the tree, from MergeCallTrees
+     */
+    void WriteCallTree(const MergedCallTreeNode& root)
+    {
+        if (m_format_ != TraceFormat::BINARY)
+        {
+            m_outputStream_ << "\"callTree\":[";
+        }
+        uint32_t nextId = 1;
+        WriteCallTreeChildren(root, 0, nextId);
+        if (m_format_ != TraceFormat::BINARY)
+        {
+            m_outputStream_ << "]";
+        }
+    }
+
+    /**
+     * Write the separator between two entries if needed.
+     * @remark Expects the output lock to be held.
+     */
+    void WriteSeparator()
+    {
+        if (m_profileCount_mem_ + m_profileCount_time_ > 0)
+            m_outputStream_ << ",";
+    }
+
+    /**
+     * Get the ID of a string in the binary trace, writing its STRING record the first time.
+     * @remark Expects the output lock to be held.
+     * @param value The string to look up, already JSON escaped
+     * @return ID of the string
+     */
+    uint32_t InternString(const std::string& value)
+    {
+        const auto [it, inserted] = m_stringIds_.try_emplace(value, static_cast<uint32_t>(m_stringIds_.size()));
+        if (inserted)
+        {
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::STRING));
+            trace_format::WriteVarint(m_outputStream_, it->second);
+            trace_format::WriteVarint(m_outputStream_, value.size());
+            m_outputStream_.write(value.data(), static_cast<std::streamsize>(value.size()));
+        }
+        return it->second;
+    }
+
+    /**
+     * Get the ID of the stack of an allocation. In binary traces its STACK record is written the first time, in JSON
+     * traces the whole table is written in the footer.
+     * @remark Expects the output lock to be held.
+     * @param profilingData The allocation whose stack is looked up
+     * @return ID of the stack
+     */
+    uint32_t InternStack(const ProfileResult_Memory& profilingData)
+    {
+        m_stackScratch_.clear();
+        for (size_t i = 0; i < profilingData.stackDepth; i++)
+        {
+            m_stackScratch_.push_back(InternFrame(profilingData.stackFrames[i]));
+        }
+
+        const auto [it, inserted] = m_stackIds_.try_emplace(m_stackScratch_, static_cast<uint32_t>(m_stackIds_.size()));
+        if (inserted && m_format_ == TraceFormat::BINARY)
+        {
+            const std::vector<uint32_t>& frames = it->first;
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::STACK));
+            trace_format::WriteVarint(m_outputStream_, it->second);
+            trace_format::WriteVarint(m_outputStream_, frames.size());
+            for (const uint32_t frame : frames)
+            {
+                trace_format::WriteVarint(m_outputStream_, frame);
+            }
+        }
+        return it->second;
+    }
+
+    /**
+     * Get the ID of a raw frame, writing its FRAME record the first time in binary traces.
+     * The frame gets symbolized later, once, when the session ends.
+     * @remark Expects the output lock to be held.
+     * @param entry The frame to look up
+     * @return ID of the frame
+     */
+    uint32_t InternFrame(const std::stacktrace_entry& entry)
+    {
+        const auto [it, inserted] = m_frameIds_.try_emplace(entry, static_cast<uint32_t>(m_frameIds_.size()));
+        if (inserted && m_format_ == TraceFormat::BINARY)
+        {
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::FRAME));
+            trace_format::WriteVarint(m_outputStream_, it->second);
+            trace_format::WriteVarint(m_outputStream_, entry.native_handle());
+        }
+        return it->second;
+    }
+
+    /**
+     * Resolve the symbol of a frame. This is the expensive part, it should only happen once per unique frame.
+     * @param entry The frame to symbolize
+     * @return The symbol, already escaped for the output
+     */
+    static std::string Symbolize(const std::stacktrace_entry& entry)
+    {
+        std::string symbol = std::to_string(entry);
+        std::ranges::replace(symbol, '\\', '/');
+        return trace_format::EscapeJson(symbol);
+    }
+
+    /**
+     * Resolve every frame referenced by a binary trace in one go and write the SYMBOL records.
+     * @remark Expects the output lock to be held.
+     */
+    void WriteSymbols()
+    {
+        for (const auto& [entry, frameId] : m_frameIds_)
+        {
+            const uint32_t symbolId = InternString(Symbolize(entry));
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::SYMBOL));
+            trace_format::WriteVarint(m_outputStream_, frameId);
+            trace_format::WriteVarint(m_outputStream_, symbolId);
+        }
+    }
+
+    /**
+     * Write the stack and frame tables that JSON memory entries refer to by stackId.
+     * Every frame gets symbolized here in one go.
+     * @remark Expects the output lock to be held.
+     */
+    void WriteStackTables()
+    {
+        std::vector<const std::vector<uint32_t>*> stacks(m_stackIds_.size());
+        for (const auto& [frames, stackId] : m_stackIds_)
+        {
+            stacks[stackId] = &frames;
+        }
+
+        m_outputStream_ << "\"stacks\":[";
+        for (size_t i = 0; i < stacks.size(); i++)
+        {
+            m_outputStream_ << (i > 0 ? ",[" : "[");
+            for (size_t j = 0; j < stacks[i]->size(); j++)
+            {
+                m_outputStream_ << (j > 0 ? "," : "") << (*stacks[i])[j];
+            }
+            m_outputStream_ << "]";
+        }
+        m_outputStream_ << "],";
+
+        std::vector<const std::stacktrace_entry*> frames(m_frameIds_.size());
+        for (const auto& [entry, frameId] : m_frameIds_)
+        {
+            frames[frameId] = &entry;
+        }
+
+        m_outputStream_ << "\"frames\":[";
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            m_outputStream_ << (i > 0 ? ",\"" : "\"") << Symbolize(*frames[i]) << "\"";
+        }
+        m_outputStream_ << "]";
+    }
+
+    /**
+     * Write a histogram as an array, leaving out the empty buckets at the end.
+     * @remark Expects the output lock to be held.
+     * @param histogram The histogram to write
+     */
+    void WriteHistogram(const std::array<uint64_t, ProfileResult_MemorySummary::histogramBuckets>& histogram)
+    {
+        size_t used = histogram.size();
+        while (used > 0 && histogram[used - 1] == 0)
+        {
+            used--;
+        }
+
+        m_outputStream_ << "[";
+        for (size_t i = 0; i < used; i++)
+        {
+            m_outputStream_ << (i > 0 ? "," : "") << histogram[i];
+        }
+        m_outputStream_ << "]";
+    }
+
+    /**
+     * Write the summaries of the aggregate memory profilers of the session.
+     * @remark Expects the output lock to be held.
+     */
+    void WriteMemorySummaries()
+    {
+        m_outputStream_ << "\"memorySummaries\":[";
+        for (size_t i = 0; i < m_memorySummaries_.size(); i++)
+        {
+            const ProfileResult_MemorySummary& summary = m_memorySummaries_[i];
+            m_outputStream_ << (i > 0 ? ",{" : "{");
+            m_outputStream_ << "\"name\":\"" << trace_format::EscapeJson(summary.name) << "\",";
+            m_outputStream_ << "\"allocations\":" << summary.allocations << ",";
+            m_outputStream_ << "\"deallocations\":" << summary.deallocations << ",";
+            m_outputStream_ << "\"bytesAllocated\":" << summary.bytesAllocated << ",";
+            m_outputStream_ << "\"bytesDeallocated\":" << summary.bytesDeallocated << ",";
+            m_outputStream_ << "\"liveBytes\":" << summary.LiveBytes() << ",";
+            m_outputStream_ << "\"peakBytes\":" << summary.peakBytes << ",";
+            m_outputStream_ << "\"allocationHistogram\":";
+            WriteHistogram(summary.allocationHistogram);
+            m_outputStream_ << ",\"deallocationHistogram\":";
+            WriteHistogram(summary.deallocationHistogram);
+            m_outputStream_ << ",\"scopes\":[";
+            for (size_t j = 0; j < summary.scopes.size(); j++)
+            {
+                m_outputStream_ << (j > 0 ? ",{" : "{");
+                m_outputStream_ << "\"sid\":" << summary.scopes[j].callSite->GetId() << ",";
+                m_outputStream_ << "\"allocations\":" << summary.scopes[j].allocations << ",";
+                m_outputStream_ << "\"bytesAllocated\":" << summary.scopes[j].bytesAllocated;
+                m_outputStream_ << "}";
+            }
+            m_outputStream_ << "]}";
+        }
+        m_outputStream_ << "]";
+    }
+
+    /**
+     * Write the peak snapshots of the memory profilers of the session.
+     * @remark Expects the output lock to be held.
+     */
+    void WritePeakSnapshots()
+    {
+        m_outputStream_ << "\"peakSnapshots\":[";
+        for (size_t i = 0; i < m_peakSnapshots_.size(); i++)
+        {
+            m_outputStream_ << (i > 0 ? "," : "") << m_peakSnapshots_[i];
+        }
+        m_outputStream_ << "]";
+    }
+
+    /**
+     * Write clock ticks into a JSON trace as microseconds.
+     * @param ticks Timestamp or duration in ProfileClock ticks
+     */
+    void WriteTime(const long long ticks)
+    {
+        trace_format::WriteMicroseconds(m_outputStream_, ticks, ProfileClock::TicksPerSecond());
+    }
+
+    /**
+     * Write a timestamp as the difference with the previous one.
+     * @remark Expects the output lock to be held.
+     * @param timestamp Timestamp to write
+     */
+    void WriteTimestampDelta(const long long timestamp)
+    {
+        trace_format::WriteSignedVarint(m_outputStream_, timestamp - m_lastTimestamp_);
+        m_lastTimestamp_ = timestamp;
+    }
+
+public:
+    /**
+     * Default size at which the front buffer is considered full.
+     */
+    static constexpr size_t defaultBufferLimit = 16 * 1024 * 1024;
+
+    /**
+     * Construct an instrumentor with default values. Get() is the default one, build more to write independent
+     * sessions at the same time.
+     */
+    Instrumentor():
+        m_currentSession_(nullptr),
+        m_profileCount_mem_(0),
+        m_profileCount_time_(0),
+        m_id_(nextId_.fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+
+    Instrumentor(const Instrumentor&) = delete;
+    Instrumentor& operator=(const Instrumentor&) = delete;
+
+    /**
+     * Close the session if the program exits without ending it, so the buffered entries still reach the file.
+     */
+    ~Instrumentor()
+    {
+        if (m_currentSession_)
+        {
+            EndSession();
+        }
+        if (threadInstrumentor_ == this)
+        {
+            threadInstrumentor_ = nullptr;
+        }
+    }
+
+    /**
+     * Choose when the buffered trace gets handed to the writer thread, which writes it into the results file. Entries are
+     * never written one by one, the buffers always get written at the end of the session.
+     * @param policy The flush policy
+     * @param threshold Bytes for FlushPolicy::EVERY_N_BYTES, milliseconds for FlushPolicy::EVERY_T_MILLISECONDS,
+     * ignored for FlushPolicy::SESSION_END
+     */
+    void SetFlushPolicy(const FlushPolicy policy, const size_t threshold)
+    {
+        std::lock_guard outputLock(m_outputMutex_);
+        m_flushPolicy_ = policy;
+        m_flushThreshold_ = threshold;
+        if (policy == FlushPolicy::EVERY_N_BYTES)
+        {
+            ProfileLock lock;
+            for (TraceBuffer& buffer : m_outputBuffers_)
+            {
+                buffer.Reserve(threshold);
+            }
+        }
+    }
+
+    /**
+     * Choose what happens when entries are produced faster than the writer thread can write them.
+     * @param policy The backpressure policy
+     * @param bufferLimit Size in bytes at which the front buffer is considered full. Ignored for BackpressurePolicy::GROW
+     */
+    void SetBackpressurePolicy(const BackpressurePolicy policy, const size_t bufferLimit = defaultBufferLimit)
+    {
+        std::lock_guard outputLock(m_outputMutex_);
+        m_backpressurePolicy_ = policy;
+        m_bufferLimit_ = bufferLimit;
+    }
+
+    /**
+     * Amount of entries dropped by BackpressurePolicy::DROP in the current session.
+     * @return The amount of dropped entries
+     */
+    [[nodiscard]] uint64_t GetDroppedEntries() const
+    {
+        return m_droppedEntries_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Choose what is kept of closed timer scopes.
+     * @param mode The timer mode
+     * @throws error Errors if a session is running, the scopes already open were started with the previous mode
+     */
+    void SetTimerMode(const TimerMode mode)
+    {
+        if (m_currentSession_)
+        {
+            throw "The timer mode can't change while a profiling session is running";
+        }
+        m_timerMode_.store(mode, std::memory_order_relaxed);
+    }
+
+    /**
+     * Get what is kept of closed timer scopes.
+     * @return The timer mode
+     */
+    [[nodiscard]] TimerMode GetTimerMode() const
+    {
+        return m_timerMode_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Start a profiling session.
+     * @param name Name of the session
+     * @param filepath Path to save the session info into.
+     * @param format Format of the output file. Binary traces can be turned back into JSON with trace_format::ConvertToJson
+     * @param clock Source of the timestamps. It gets calibrated here, which takes a few milliseconds for ClockSource::TSC.
+     * The clock is calibrated once and shared by every session, it's ignored if a timestamp was already taken.
+     */
+    void BeginSession(const std::string& name, const std::string& filepath = "results.json",
+                      const TraceFormat format = TraceFormat::JSON, const ClockSource clock = ClockSource::TSC)
+    {
+        if (m_currentSession_)
+        {
+            throw
+                "There is already a profiling session running. Make sure you're not calling START_SESSION(name) more than once";
+        }
+
+        ProfileClock::Calibrate(clock);
+        {
+            // The trees outlive sessions, only what they counted so far is dropped.
+            std::lock_guard buffersLock(m_timerBuffersMutex_);
+            for (const auto& tree : m_callTrees_)
+            {
+                tree->Reset();
+            }
+        }
+        {
+            std::lock_guard frameLock(m_frameMutex_);
+            m_currentFrame_ = {};
+            m_frameMemory_ = nullptr;
+        }
+        m_format_ = format;
+        m_outputFile_.open(filepath, format == TraceFormat::BINARY ? std::ios::binary : std::ios::out);
+        m_lastFlush_ = std::chrono::steady_clock::now();
+        m_currentSession_ = new InstrumentationSession{name};
+        WriteHeader();
+
+        m_writerActive_ = true;
+        m_sessionRunning_.store(true, std::memory_order_release);
+        m_writerThread_ = std::thread(&Instrumentor::WriterLoop, this);
+    }
+
+    /**
+     * End the current profiling session.
+     * @throws error Errors if trying to end a session before it starts/
+     */
+    void EndSession()
+    {
+        if (!m_currentSession_)
+        {
+            throw "Closing a session was requested even though there's no sessions running.";
+        }
+
+        {
+            // Under the lock so producers waiting for the back buffer can't miss the writer going away.
+            std::lock_guard outputLock(m_outputMutex_);
+            m_sessionRunning_.store(false, std::memory_order_release);
+        }
+        m_writerWake_.notify_one();
+        m_writerThread_.join();
+        // Whatever got pushed between the last drain and the thread exiting.
+        DrainTimerBuffers();
+
+        WriteFooter(MergeCallTrees());
+        if (m_backBufferPending_)
+        {
+            WriteBackBuffer();
+        }
+        m_outputBuffers_[m_frontBuffer_].WriteTo(m_outputFile_);
+        m_outputFile_.close();
+        m_droppedEntries_.store(0, std::memory_order_relaxed);
+        delete m_currentSession_;
+        m_currentSession_ = nullptr;
+        m_profileCount_mem_ = 0;
+        m_profileCount_time_ = 0;
+        m_stringIds_.clear();
+        m_stackIds_.clear();
+        m_frameIds_.clear();
+        m_memorySummaries_.clear();
+        m_peakSnapshots_.clear();
+        m_sessionCallSites_.clear();
+        m_lastTimestamp_ = 0;
+    }
+
+    /**
+     * Get the call site standing in for timers created with a plain name. The name is copied, it only has to live
+     * through the call.
+     * @param name Name of the timer
+     * @return The call site of that name, created the first time the name is seen
+     */
+    const CallSite& GetNamedCallSite(const char* name)
+    {
+        ProfileLock lock;
+        std::lock_guard namedLock(m_namedCallSitesMutex_);
+        std::unique_ptr<CallSite>& callSite = m_namedCallSites_[name];
+        if (!callSite)
+        {
+            callSite = std::make_unique<CallSite>(name, "", 0);
+        }
+        return *callSite;
+    }
+
+    /**
+     * Hand a closed timer scope over to the writer thread. This only costs a store into the ring of the calling thread.
+     * @param record The data of the timer profiling result
+     */
+    void SubmitTimer(const TimerRecord& record)
+    {
+        if (!m_sessionRunning_.load(std::memory_order_relaxed) || TimerRingBuffer::CallerExiting())
+            return;
+
+        TimerRingBuffer& buffer = GetThreadTimerBuffer();
+        if (m_backpressurePolicy_ == BackpressurePolicy::GROW)
+        {
+            buffer.PushGrowing(record);
+            return;
+        }
+
+        while (!buffer.TryPush(record))
+        {
+            if (m_backpressurePolicy_ == BackpressurePolicy::DROP || !m_sessionRunning_.load(std::memory_order_relaxed))
+            {
+                m_droppedEntries_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // The writer is behind, nudge it and sleep until it drained the rings instead of losing the record.
+            m_writerWake_.notify_one();
+            ProfileLock lock;
+            std::unique_lock spaceLock(m_timerSpaceMutex_);
+            m_timerSpaceFreed_.wait_for(spaceLock, std::chrono::milliseconds(1));
+        }
+    }
+
+    /**
+     * Add a memory profiler whose peaks the writer thread watches while a session runs.
+     * @param memoryProfiler The memory profiler being started
+     */
+    void AddMemoryProfiler(InstrumentationMemory* memoryProfiler)
+    {
+        ProfileLock lock;
+        std::lock_guard profilersLock(m_memoryProfilersMutex_);
+        m_memoryProfilers_.push_back(memoryProfiler);
+    }
+
+    /**
+     * Stop watching the peaks of a memory profiler. Once this returns the writer thread doesn't touch it anymore.
+     * @param memoryProfiler The memory profiler being stopped
+     */
+    void RemoveMemoryProfiler(InstrumentationMemory* memoryProfiler)
+    {
+        std::lock_guard profilersLock(m_memoryProfilersMutex_);
+        std::erase(m_memoryProfilers_, memoryProfiler);
+    }
+
+    /**
+     * Mark the end of a frame and the start of the next one. Frames are written when they end, so the first mark only
+     * starts frame 1. The allocations of a frame are the ones counted by the memory profiler of the marking thread.
+     */
+    void MarkFrame();
+
+    /**
+     * Write a frame into the file. JSON traces get it as a complete event on its own track.
+     * @param frame The frame
+     */
+    void WriteProfile(const ProfileResult_Frame& frame)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::FRAME_MARK));
+            trace_format::WriteVarint(m_outputStream_, frame.number);
+            WriteTimestampDelta(frame.start);
+            trace_format::WriteVarint(m_outputStream_, frame.end - frame.start);
+            trace_format::WriteVarint(m_outputStream_, frame.allocations);
+            trace_format::WriteVarint(m_outputStream_, frame.bytesAllocated);
+            m_profileCount_time_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_time_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"frame\",";
+        m_outputStream_ << "\"dur\":";
+        WriteTime(frame.end - frame.start);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"name\":\"Frame " << frame.number << "\",";
+        m_outputStream_ << "\"ph\":\"X\",";
+        m_outputStream_ << "\"pid\":0,";
+        m_outputStream_ << "\"tid\":0,";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(frame.start);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"args\":{\"frame\":" << frame.number << ",";
+        m_outputStream_ << "\"allocations\":" << frame.allocations << ",";
+        m_outputStream_ << "\"bytesAllocated\":" << frame.bytesAllocated << "}";
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Enter a timer scope in the call tree of the calling thread, used by TimerMode::CALL_TREE.
+     * @param callSite Call site of the timer
+     * @return Node to hand back to ExitScope, nullptr if no session is running
+     */
+    CallTreeNode* EnterScope(const CallSite& callSite)
+    {
+        if (!m_sessionRunning_.load(std::memory_order_relaxed))
+            return nullptr;
+
+        return GetThreadCallTree().Enter(callSite);
+    }
+
+    /**
+     * Exit a timer scope entered with EnterScope and add the call to its node.
+     * @param node Node returned by EnterScope
+     * @param duration How long the call took, in ProfileClock ticks
+     */
+    void ExitScope(CallTreeNode* node, const long long duration)
+    {
+        GetThreadCallTree().Exit(node, static_cast<uint64_t>(std::max(duration, 0ll)));
+    }
+
+    /**
+     * Write the profiling data of a timer profiling into the file.
+     * @param profilingData The data of the timer profiling result
+     */
+    void WriteProfile(const ProfileResult_Time& profilingData)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        const CallSite& callSite = *profilingData.callSite;
+        UseCallSite(callSite);
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::TIMER));
+            trace_format::WriteVarint(m_outputStream_, callSite.GetId());
+            trace_format::WriteVarint(m_outputStream_, profilingData.threadId);
+            WriteTimestampDelta(profilingData.start);
+            trace_format::WriteVarint(m_outputStream_, profilingData.end - profilingData.start);
+            m_profileCount_time_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_time_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"function\",";
+        m_outputStream_ << "\"dur\":";
+        WriteTime(profilingData.end - profilingData.start);
+        m_outputStream_ << ',';
+        // The name is still written so chrome://tracing can read the file, it was escaped once when the call site got built.
+        m_outputStream_ << "\"name\":\"" << callSite.GetName() << "\",";
+        m_outputStream_ << "\"sid\":" << callSite.GetId() << ",";
+        m_outputStream_ << "\"ph\":\"X\",";
+        m_outputStream_ << "\"pid\":0,";
+        m_outputStream_ << "\"tid\":" << profilingData.threadId << ",";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(profilingData.start);
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write the profiling data of a memory profiling session into the file.
+     * @param profilingData The data of the memory profiling result
+     */
+    void WriteProfile(const ProfileResult_Memory& profilingData)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        const bool sampled = profilingData.sampleWeight != 1.0;
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t stackId = InternStack(profilingData);
+
+            const bool deallocated = profilingData.end >= 0;
+            uint8_t flags = trace_format::NONE;
+            flags |= profilingData.isArray ? trace_format::IS_ARRAY : trace_format::NONE;
+            flags |= deallocated ? trace_format::DEALLOCATED : trace_format::NONE;
+            flags |= sampled ? trace_format::SAMPLED : trace_format::NONE;
+            if (profilingData.scope != nullptr)
+            {
+                UseCallSite(*profilingData.scope);
+            }
+
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::MEMORY));
+            m_outputStream_.put(static_cast<char>(flags));
+            trace_format::WriteVarint(m_outputStream_, profilingData.threadId);
+            trace_format::WriteVarint(m_outputStream_, reinterpret_cast<uintptr_t>(profilingData.location));
+            trace_format::WriteVarint(m_outputStream_, profilingData.size);
+            WriteTimestampDelta(profilingData.start);
+            if (deallocated)
+            {
+                trace_format::WriteVarint(m_outputStream_, profilingData.end - profilingData.start);
+            }
+            trace_format::WriteVarint(m_outputStream_, stackId);
+            if (sampled)
+            {
+                trace_format::WriteVarint(m_outputStream_, static_cast<uint64_t>(std::llround(
+                                              profilingData.sampleWeight * static_cast<double>(profilingData.size))));
+            }
+            trace_format::WriteVarint(m_outputStream_, ScopeReference(profilingData.scope));
+            m_profileCount_mem_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_mem_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"" << ((profilingData.end >= 0) ? "Deallocated mem" : "Memory leaked") << "\",";
+        m_outputStream_ << "\"dur(us)\":";
+        if (profilingData.end >= 0)
+            WriteTime(profilingData.end - profilingData.start);
+        else
+            m_outputStream_ << -1;
+        m_outputStream_ << ',';
+        m_outputStream_ << "\"name\":\"" << profilingData.location << "\",";
+        m_outputStream_ << "\"tid\":" << profilingData.threadId << ",";
+        m_outputStream_ << "\"tStart\":";
+        WriteTime(profilingData.start);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"tEnd\":";
+        if (profilingData.end >= 0)
+            WriteTime(profilingData.end);
+        else
+            m_outputStream_ << -1;
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"size\":" << profilingData.size << ",";
+        if (sampled)
+        {
+            m_outputStream_ << "\"sampleWeight\":" << profilingData.sampleWeight << ",";
+            m_outputStream_ << "\"estimatedSize\":" << std::llround(
+                profilingData.sampleWeight * static_cast<double>(profilingData.size)) << ",";
+        }
+        WriteScope(profilingData.scope);
+        m_outputStream_ << "\"stackId\":" << InternStack(profilingData);
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write an allocation as soon as it happens, used by streaming memory profilers.
+     * @param profilingData The allocation
+     */
+    void WriteAllocationEvent(const ProfileResult_Memory& profilingData)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t stackId = InternStack(profilingData);
+            if (profilingData.scope != nullptr)
+            {
+                UseCallSite(*profilingData.scope);
+            }
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::ALLOCATION));
+            trace_format::WriteVarint(m_outputStream_, profilingData.threadId);
+            trace_format::WriteVarint(m_outputStream_, reinterpret_cast<uintptr_t>(profilingData.location));
+            trace_format::WriteVarint(m_outputStream_, profilingData.size);
+            WriteTimestampDelta(profilingData.start);
+            trace_format::WriteVarint(m_outputStream_, stackId);
+            trace_format::WriteVarint(m_outputStream_, ScopeReference(profilingData.scope));
+            m_profileCount_mem_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_mem_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"alloc\",";
+        m_outputStream_ << "\"name\":\"" << profilingData.location << "\",";
+        m_outputStream_ << "\"tid\":" << profilingData.threadId << ",";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(profilingData.start);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"size\":" << profilingData.size << ",";
+        WriteScope(profilingData.scope);
+        m_outputStream_ << "\"stackId\":" << InternStack(profilingData);
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write a deallocation as soon as it happens, used by streaming memory profilers.
+     * @param location Address of the memory being deallocated
+     * @param threadId Thread deallocating the memory
+     * @param timestamp Time stamp of the deallocation
+     */
+    void WriteDeallocationEvent(void* location, const uint32_t threadId, const long long timestamp)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::DEALLOCATION));
+            trace_format::WriteVarint(m_outputStream_, threadId);
+            trace_format::WriteVarint(m_outputStream_, reinterpret_cast<uintptr_t>(location));
+            WriteTimestampDelta(timestamp);
+            m_profileCount_mem_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_mem_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"free\",";
+        m_outputStream_ << "\"name\":\"" << location << "\",";
+        m_outputStream_ << "\"tid\":" << threadId << ",";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(timestamp);
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write a new high-water mark of a memory profiler. JSON traces get it as a counter event.
+     * @param name Name of the memory profiler, as a named call site
+     * @param timestamp When the mark was reached
+     * @param liveBytes Live bytes of the profiler at that moment
+     */
+    void WritePeak(const CallSite& name, const long long timestamp, const uint64_t liveBytes)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t nameId = InternString(name.GetName());
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::PEAK));
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            WriteTimestampDelta(timestamp);
+            trace_format::WriteVarint(m_outputStream_, liveBytes);
+            m_profileCount_mem_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_mem_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"peak\",";
+        m_outputStream_ << "\"name\":\"" << name.GetName() << "\",";
+        m_outputStream_ << "\"ph\":\"C\",";
+        m_outputStream_ << "\"pid\":0,";
+        m_outputStream_ << "\"tid\":0,";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(timestamp);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"args\":{\"liveBytes\":" << liveBytes << "}";
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write a sample of the live counters of a memory profiler. JSON traces get it as two counter events, one for the
+     * live bytes, on the same track as the peaks, and one for the live allocations.
+     * @param name Name of the memory profiler
+     * @param timestamp When the counters were read
+     * @param liveBytes Live bytes of the profiler at that moment
+     * @param liveAllocations Live allocations of the profiler at that moment
+     */
+    void WriteCounters(const std::string& name, const long long timestamp, const uint64_t liveBytes,
+                       const uint64_t liveAllocations)
+    {
+        std::unique_lock outputLock(m_outputMutex_);
+        if (!ReserveSpace(outputLock))
+        {
+            return;
+        }
+
+        const std::string escapedName = trace_format::EscapeJson(name);
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t nameId = InternString(escapedName);
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::COUNTERS));
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            WriteTimestampDelta(timestamp);
+            trace_format::WriteVarint(m_outputStream_, liveBytes);
+            trace_format::WriteVarint(m_outputStream_, liveAllocations);
+            m_profileCount_mem_++;
+            FlushIfDue();
+            return;
+        }
+
+        WriteSeparator();
+        m_profileCount_mem_++;
+
+        m_outputStream_ << "{";
+        m_outputStream_ << "\"cat\":\"counters\",";
+        m_outputStream_ << "\"name\":\"" << escapedName << "\",";
+        m_outputStream_ << "\"ph\":\"C\",";
+        m_outputStream_ << "\"pid\":0,";
+        m_outputStream_ << "\"tid\":0,";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(timestamp);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"args\":{\"liveBytes\":" << liveBytes << "}";
+        m_outputStream_ << "},{";
+        m_outputStream_ << "\"cat\":\"counters\",";
+        m_outputStream_ << "\"name\":\"" << escapedName << " allocations\",";
+        m_outputStream_ << "\"ph\":\"C\",";
+        m_outputStream_ << "\"pid\":0,";
+        m_outputStream_ << "\"tid\":0,";
+        m_outputStream_ << "\"ts\":";
+        WriteTime(timestamp);
+        m_outputStream_ << ",";
+        m_outputStream_ << "\"args\":{\"liveAllocations\":" << liveAllocations << "}";
+        m_outputStream_ << "}";
+
+        FlushIfDue();
+    }
+
+    /**
+     * Write what was live at the highest peak of a memory profiler. JSON sessions keep it until the footer.
+     * @param snapshot The live set at the peak
+     */
+    void WriteProfile(const ProfileResult_PeakSnapshot& snapshot)
+    {
+        std::lock_guard outputLock(m_outputMutex_);
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t nameId = InternString(trace_format::EscapeJson(snapshot.name));
+            // Stacks first, their records can't be written in the middle of this one.
+            std::vector<uint32_t> stackIds;
+            stackIds.reserve(snapshot.sites.size());
+            for (const ProfileResult_PeakSite& site : snapshot.sites)
+            {
+                stackIds.push_back(InternStack(site.allocation));
+            }
+
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::PEAK_SNAPSHOT));
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            WriteTimestampDelta(snapshot.timestamp);
+            trace_format::WriteVarint(m_outputStream_, snapshot.liveBytes);
+            trace_format::WriteVarint(m_outputStream_, snapshot.sites.size());
+            for (size_t i = 0; i < snapshot.sites.size(); i++)
+            {
+                trace_format::WriteVarint(m_outputStream_, stackIds[i]);
+                trace_format::WriteVarint(m_outputStream_, snapshot.sites[i].bytes);
+                trace_format::WriteVarint(m_outputStream_, snapshot.sites[i].count);
+            }
+            FlushIfDue();
+            return;
+        }
+
+        std::ostringstream formatted;
+        formatted << "{";
+        formatted << "\"name\":\"" << trace_format::EscapeJson(snapshot.name) << "\",";
+        formatted << "\"ts\":";
+        trace_format::WriteMicroseconds(formatted, snapshot.timestamp, ProfileClock::TicksPerSecond());
+        formatted << ",";
+        formatted << "\"liveBytes\":" << snapshot.liveBytes << ",";
+        formatted << "\"sites\":[";
+        for (size_t i = 0; i < snapshot.sites.size(); i++)
+        {
+            formatted << (i > 0 ? ",{" : "{");
+            formatted << "\"stackId\":" << InternStack(snapshot.sites[i].allocation) << ",";
+            formatted << "\"bytes\":" << snapshot.sites[i].bytes << ",";
+            formatted << "\"count\":" << snapshot.sites[i].count;
+            formatted << "}";
+        }
+        formatted << "]}";
+        m_peakSnapshots_.push_back(formatted.str());
+    }
+
+    /**
+     * Write the summary of an aggregate memory profiling. JSON sessions keep it until the footer.
+     * @param summary The merged counters of the memory profiler
+     */
+    void WriteProfile(const ProfileResult_MemorySummary& summary)
+    {
+        std::lock_guard outputLock(m_outputMutex_);
+        for (const ProfileResult_ScopeSummary& scope : summary.scopes)
+        {
+            UseCallSite(*scope.callSite);
+        }
+
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            const uint32_t nameId = InternString(trace_format::EscapeJson(summary.name));
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::MEMORY_SUMMARY));
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            trace_format::WriteVarint(m_outputStream_, summary.allocations);
+            trace_format::WriteVarint(m_outputStream_, summary.deallocations);
+            trace_format::WriteVarint(m_outputStream_, summary.bytesAllocated);
+            trace_format::WriteVarint(m_outputStream_, summary.bytesDeallocated);
+            trace_format::WriteVarint(m_outputStream_, summary.peakBytes);
+            for (const auto& histogram : {summary.allocationHistogram, summary.deallocationHistogram})
+            {
+                for (const uint64_t bucket : histogram)
+                {
+                    trace_format::WriteVarint(m_outputStream_, bucket);
+                }
+            }
+            trace_format::WriteVarint(m_outputStream_, summary.scopes.size());
+            for (const ProfileResult_ScopeSummary& scope : summary.scopes)
+            {
+                trace_format::WriteVarint(m_outputStream_, scope.callSite->GetId());
+                trace_format::WriteVarint(m_outputStream_, scope.allocations);
+                trace_format::WriteVarint(m_outputStream_, scope.bytesAllocated);
+            }
+            FlushIfDue();
+            return;
+        }
+
+        m_memorySummaries_.push_back(summary);
+    }
+
+    /**
+     * Write the results file header.
+     */
+    void WriteHeader()
+    {
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            trace_format::WriteHeader(m_outputStream_);
+            const uint32_t nameId = InternString(trace_format::EscapeJson(m_currentSession_->name));
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::SESSION));
+            trace_format::WriteVarint(m_outputStream_, nameId);
+            trace_format::WriteVarint(m_outputStream_, static_cast<uint64_t>(ProfileClock::GetSource()));
+            trace_format::WriteVarint(m_outputStream_, ProfileClock::TicksPerSecond());
+            FlushIfDue();
+            return;
+        }
+
+        m_outputStream_ << "{\"otherData\": {\"clock\":\"";
+        m_outputStream_ << (ProfileClock::GetSource() == ClockSource::TSC ? "tsc" : "steady") << "\",";
+        m_outputStream_ << "\"ticksPerSecond\":" << ProfileClock::TicksPerSecond() << "},\"traceEvents\":[";
+        FlushIfDue();
+    }
+
+    /**
+     * Write the results file footer.
+     * @param callTree Call trees of every thread merged, from MergeCallTrees
+     */
+    void WriteFooter(const MergedCallTreeNode& callTree)
+    {
+        if (m_format_ == TraceFormat::BINARY)
+        {
+            WriteCallTree(callTree);
+            WriteSymbols();
+            if (const uint64_t dropped = m_droppedEntries_.load(std::memory_order_relaxed); dropped > 0)
+            {
+                m_outputStream_.put(static_cast<char>(trace_format::RECORD::DROPPED));
+                trace_format::WriteVarint(m_outputStream_, dropped);
+            }
+            m_outputStream_.put(static_cast<char>(trace_format::RECORD::END));
+            return;
+        }
+
+        m_outputStream_ << "],";
+        WriteStackTables();
+        m_outputStream_ << ",";
+        WriteMemorySummaries();
+        m_outputStream_ << ",";
+        WritePeakSnapshots();
+        m_outputStream_ << ",";
+        // Before the call sites, it's what marks the call sites of the tree as used
+        WriteCallTree(callTree);
+        m_outputStream_ << ",";
+        WriteCallSites();
+        m_outputStream_ << ",\"droppedEntries\":" << m_droppedEntries_.load(std::memory_order_relaxed);
+        m_outputStream_ << "}";
+    }
+
+    /**
+     * Get the singleton instance
+     * @return A reference to the Instrumentor singleton instance
+     */
+    static Instrumentor& Get()
+    {
+        static Instrumentor instance;
+        return instance;
+    }
+
+    /**
+     * Get the instrumentor the calling thread writes its events into.
+     * @return The instrumentor the thread is bound to, the default one if it isn't bound
+     */
+    static Instrumentor& Current()
+    {
+        return threadInstrumentor_ != nullptr ? *threadInstrumentor_ : Get();
+    }
+
+    /**
+     * Send the events of the calling thread to this instrumentor. Timers and memory profilers pick their instrumentor
+     * when they get created, the ones already running keep theirs.
+     */
+    void BindThread()
+    {
+        threadInstrumentor_ = this;
+    }
+
+    /**
+     * Send the events of the calling thread back to the default instrumentor.
+     */
+    static void UnbindThread()
+    {
+        threadInstrumentor_ = nullptr;
+    }
+
+    /**
+     * Register a memory profiler. The first one registered while none is running becomes the root, which gets the
+     * allocations of every thread that didn't start a profiler of its own.
+     * @param instrumentation Pointer to the memory profiler being started
+     */
+    static void RegisterInstrumentation(InstrumentationMemory* instrumentation)
+    {
+        InstrumentationMemory* expected = nullptr;
+        rootMemory_.compare_exchange_strong(expected, instrumentation);
+    }
+
+    /**
+     * Unregister a memory profiler so that threads without a profiler of their own stop routing allocations to it.
+     * @param instrumentation Pointer to the memory profiler that is being stopped
+     */
+    static void UnregisterInstrumentation(InstrumentationMemory* instrumentation)
+    {
+        rootMemory_.compare_exchange_strong(instrumentation, nullptr);
+    }
+
+    /**
+     * Get the memory profiler every thread without a profiler of its own falls back to.
+     * @return Pointer to the root memory profiler. nullptr if none is running.
+     */
+    static InstrumentationMemory* GetRootMemoryInstrumentation()
+    {
+        return rootMemory_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Get the memory profiler allocations of the calling thread are attributed to.
+     * @return Pointer to the innermost memory profiler of the calling thread, or the root one if the thread didn't
+     * start any. nullptr if none have been registered.
+     */
+    static InstrumentationMemory* GetCurrentMemoryInstrumentation();
+};
+
+/**
+ * A class to manage a timer in a scope automatically.
+ */
+class InstrumentationTimer final
+{
+public:
+    /**
+     * Create and start a timer with a given name. The name gets looked up every time, PROFILE_SCOPE_TIME is the cheap
+     * way for names known at compile time.
+     * @param name Name of the timer, copied so it doesn't have to outlive the timer
+     */
+    explicit InstrumentationTimer(const char* name)
+        : InstrumentationTimer(Instrumentor::Current().GetNamedCallSite(name))
+    {
+    }
+
+    /**
+     * Create and start a timer for a call site. This is what PROFILE_SCOPE_TIME uses.
+     * @param callSite Static description of where the timer is
+     */
+    explicit InstrumentationTimer(const CallSite& callSite)
+        : m_session_(Instrumentor::Current()), m_callSite_(&callSite), m_stopped_(false), m_parent_(innermost_)
+    {
+        innermost_ = this;
+        if (m_session_.GetTimerMode() == TimerMode::CALL_TREE)
+            m_node_ = m_session_.EnterScope(callSite);
+        m_startTimepoint_ = ProfileClock::Now();
+    }
+
+    /**
+     * Destroy and stop a timer.
+     */
+    ~InstrumentationTimer()
+    {
+        if (!m_stopped_)
+            Stop();
+    }
+
+    /**
+     * Stop a timer manually. This is not necessary under normal conditions.
+     */
+    void Stop()
+    {
+        const long long end = ProfileClock::NowOrdered();
+
+        if (m_node_ != nullptr)
+        {
+            m_session_.ExitScope(m_node_, end - m_startTimepoint_);
+        }
+        else if (m_session_.GetTimerMode() == TimerMode::EVENTS)
+        {
+            const uint32_t threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            m_session_.SubmitTimer({m_callSite_, threadId, m_startTimepoint_, end});
+        }
+
+        // Usually this is the innermost one, the walk only happens when timers are stopped out of order.
+        InstrumentationTimer** link = &innermost_;
+        while (*link != nullptr && *link != this)
+            link = &(*link)->m_parent_;
+        if (*link == this)
+            *link = m_parent_;
+
+        m_stopped_ = true;
+    }
+
+    /**
+     * Get the innermost timer scope open on the calling thread.
+     * @return Call site of the innermost scope, nullptr if no timer is running on this thread
+     */
+    static const CallSite* GetCurrentScope()
+    {
+        return innermost_ != nullptr ? innermost_->m_callSite_ : nullptr;
+    }
+
+private:
+    /**
+     * Instrumentor the timer gets written into.
+     */
+    Instrumentor& m_session_;
+    /**
+     * Where the timer is. Timers created with a plain name get the call site standing in for the name.
+     */
+    const CallSite* m_callSite_;
+    /**
+     * time point where the timer started, in ProfileClock ticks.
+     */
+    long long m_startTimepoint_;
+    /**
+     * Whether the timer is stoped.
+     * It should stay false during the lifetime of the object under normal conditions.
+     */
+    bool m_stopped_;
+    /**
+     * Timer that was the innermost one of the thread when this one started.
+     */
+    InstrumentationTimer* m_parent_;
+    /**
+     * Node of the scope in the call tree of the thread, nullptr unless the session aggregates timers into call trees.
+     */
+    CallTreeNode* m_node_ = nullptr;
+    /**
+     * Innermost running timer of each thread, the top of its stack of scopes.
+     */
+    static inline thread_local InstrumentationTimer* innermost_ = nullptr;
+};
+
+/**
+ * Flat open addressing hash table keyed by address.
+ * Its storage comes straight from the OS (mmap/VirtualAlloc) so using it never goes through the operator new being
+ * profiled. Keys and values live in separate arrays so probing only touches keys. Collisions are resolved with linear
+ * probing and erasing shifts the following entries back instead of leaving tombstones.
+ * @tparam Value Type stored per address. It must be trivially copyable since it gets moved around with the slots.
+ */
+template <typename Value>
+class AddressTable // NOLINT(cppcoreguidelines-special-member-functions)
+{
+    static_assert(std::is_trivially_copyable_v<Value>, "AddressTable values get copied around as raw slots");
+    static_assert(alignof(Value) <= alignof(void*), "AddressTable values are stored right after the keys");
+
+public:
+    AddressTable() = default;
+    AddressTable(const AddressTable&) = delete;
+    AddressTable& operator=(const AddressTable&) = delete;
+
+    /**
+     * Return the storage to the OS.
+     */
+    ~AddressTable()
+    {
+        Release(m_keys_, m_capacity_);
+    }
+
+    /**
+     * Find the value of an address.
+     * @param key Address to look up
+     * @return Pointer to the value, nullptr if the address is not in the table
+     */
+    Value* Find(void* key)
+    {
+        if (m_size_ == 0)
+            return nullptr;
+
+        for (size_t i = Home(key, m_capacity_);; i = (i + 1) & (m_capacity_ - 1))
+        {
+            if (m_keys_[i] == key)
+                return &m_values_[i];
+            if (m_keys_[i] == nullptr)
+                return nullptr;
+        }
+    }
+
+    /**
+     * Get the value of an address, inserting it if it isn't in the table yet.
+     * @param key Address to insert, it can't be nullptr
+     * @return Reference to the value of the address
+     */
+    Value& Insert(void* key)
+    {
+        // Keep the load under 3/4 so probe sequences stay short.
+        if ((m_size_ + 1) * 4 > m_capacity_ * 3)
+            Grow();
+
+        size_t i = Home(key, m_capacity_);
+        while (m_keys_[i] != nullptr && m_keys_[i] != key)
+        {
+            i = (i + 1) & (m_capacity_ - 1);
+        }
+
+        if (m_keys_[i] == nullptr)
+        {
+            m_keys_[i] = key;
+            std::construct_at(&m_values_[i]);
+            m_size_++;
+        }
+        return m_values_[i];
+    }
+
+    /**
+     * Remove an address from the table.
+     * @param key Address to remove
+     * @return Whether the address was in the table
+     */
+    bool Erase(void* key)
+    {
+        if (m_size_ == 0)
+            return false;
+
+        size_t hole = Home(key, m_capacity_);
+        while (m_keys_[hole] != key)
+        {
+            if (m_keys_[hole] == nullptr)
+                return false;
+            hole = (hole + 1) & (m_capacity_ - 1);
+        }
+
+        // Move back every following entry that would still be found from its home slot after the move.
+        for (size_t i = (hole + 1) & (m_capacity_ - 1); m_keys_[i] != nullptr; i = (i + 1) & (m_capacity_ - 1))
+        {
+            const size_t home = Home(m_keys_[i], m_capacity_);
+            const bool homeBetween = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+            if (!homeBetween)
+            {
+                m_keys_[hole] = m_keys_[i];
+                m_values_[hole] = m_values_[i];
+                hole = i;
+            }
+        }
+
+        m_keys_[hole] = nullptr;
+        m_size_--;
+        return true;
+    }
+
+    /**
+     * Call a function on every entry of the table.
+     * @param function Callable taking the address and a reference to the value
+     */
+    template <typename Function>
+    void ForEach(Function&& function) const
+    {
+        for (size_t i = 0; i < m_capacity_; i++)
+        {
+            if (m_keys_[i] != nullptr)
+                function(m_keys_[i], m_values_[i]);
+        }
+    }
+
+    /**
+     * Get the amount of entries in the table.
+     * @return Amount of addresses stored
+     */
+    size_t Size() const
+    {
+        return m_size_;
+    }
+
+private:
+    /**
+     * Amount of slots of a table the first time something is inserted. Must be a power of two.
+     */
+    static constexpr size_t initialCapacity = 64;
+
+    /**
+     * Find the slot an address would ideally go into.
+     * @param key The address
+     * @param capacity Amount of slots, a power of two
+     * @return Index of the home slot
+     */
+    static size_t Home(void* key, const size_t capacity)
+    {
+        // Fibonacci hashing, the top bits of the product are the best mixed ones.
+        const uint64_t hash = (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key)) >> 4) * 0xD6E8FEB86659FD93ull;
+        return static_cast<size_t>(hash >> (64 - std::countr_zero(capacity)));
+    }
+
+    /**
+     * Get the amount of bytes of a mapping for a given amount of slots.
+     * @param capacity Amount of slots
+     * @return Bytes to map
+     */
+    static size_t MappingSize(const size_t capacity)
+    {
+        return capacity * (sizeof(void*) + sizeof(Value));
+    }
+
+    /**
+     * Map zeroed memory for the keys and values.
+     * @param capacity Amount of slots
+     * @return The keys array, values come right after it. nullptr if the OS refused.
+     */
+    static void** Map(const size_t capacity)
+    {
+#if defined(_WIN32)
+        // MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE
+        return static_cast<void**>(VirtualAlloc(nullptr, MappingSize(capacity), 0x1000 | 0x2000, 0x04));
+#else
+        void* mapping = mmap(nullptr, MappingSize(capacity), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return mapping == MAP_FAILED ? nullptr : static_cast<void**>(mapping);
+#endif
+    }
+
+    /**
+     * Give a mapping back to the OS.
+     * @param keys The keys array returned by Map
+     * @param capacity Amount of slots it was mapped with
+     */
+    static void Release(void** keys, const size_t capacity)
+    {
+        if (keys == nullptr)
+            return;
+#if defined(_WIN32)
+        VirtualFree(keys, 0, 0x8000); // MEM_RELEASE
+#else
+        munmap(keys, MappingSize(capacity));
+#endif
+    }
+
+    /**
+     * Double the amount of slots and rehash every entry into the new storage.
+     * @throws std::bad_alloc if the OS doesn't give us the memory
+     */
+    void Grow()
+    {
+        const size_t capacity = m_capacity_ == 0 ? initialCapacity : m_capacity_ * 2;
+        void** keys = Map(capacity);
+        if (keys == nullptr)
+            throw std::bad_alloc();
+        Value* values = reinterpret_cast<Value*>(keys + capacity);
+
+        for (size_t i = 0; i < m_capacity_; i++)
+        {
+            if (m_keys_[i] == nullptr)
+                continue;
+
+            size_t j = Home(m_keys_[i], capacity);
+            while (keys[j] != nullptr)
+            {
+                j = (j + 1) & (capacity - 1);
+            }
+            keys[j] = m_keys_[i];
+            std::memcpy(&values[j], &m_values_[i], sizeof(Value));
+        }
+
+        Release(m_keys_, m_capacity_);
+        m_keys_ = keys;
+        m_values_ = values;
+        m_capacity_ = capacity;
+    }
+
+    void** m_keys_ = nullptr; /**< Addresses stored in each slot, nullptr for empty slots. */
+    Value* m_values_ = nullptr; /**< Value of each slot, right after the keys in the same mapping. */
+    size_t m_capacity_ = 0; /**< Amount of slots. Always zero or a power of two. */
+    size_t m_size_ = 0; /**< Amount of used slots. */
+};
+
+/**
+ * A class to manage memory profiling in a scope automatically.
+ * @remark It should be the first thing created in a stack to ensure that it gets deleted last.
+ * @remark Profilers nest per thread: allocations go to the innermost one, or to the root profiler on threads that didn't
+ * start any, and frees are looked up from there outwards. It has to be destroyed on the thread that created it.
+ */
+class InstrumentationMemory final
+{
+public:
+    /**
+     * Default mean amount of bytes between samples in MemoryProfileMode::SAMPLED.
+     */
+    static constexpr size_t defaultSampleInterval = 512 * 1024;
+
+    /**
+     * Default time between two publications of the live counters.
+     */
+    static constexpr std::chrono::milliseconds defaultPublishInterval{100};
+    /**
+     * Default amount of slots of the ring events get published into.
+     */
+    static constexpr uint32_t defaultEventCapacity = 1 << 16;
+    /**
+     * Default time between two counter samples written into the trace.
+     */
+    static constexpr std::chrono::milliseconds defaultCounterInterval{10};
+
+    /**
+     * Create and start a memory profiling object with a given name.
+     * @param name Name of the memory profiler
+     * @param mode How allocations get recorded
+     * @param sampleInterval Mean amount of bytes between samples. Only used in MemoryProfileMode::SAMPLED.
+     */
+    explicit InstrumentationMemory(const char* name, const MemoryProfileMode mode = MemoryProfileMode::FULL,
+                                   const size_t sampleInterval = defaultSampleInterval)
+        : m_session_(Instrumentor::Current()),
+          m_name_(name),
+          m_peakName_(m_session_.GetNamedCallSite(name)),
+          m_id_(nextId_.fetch_add(1, std::memory_order_relaxed)),
+          m_mode_(mode),
+          m_sampleInterval_(static_cast<double>(sampleInterval)),
+          m_stopped_(false),
+          m_parent_(innermost_),
+          m_ownerThread_(std::this_thread::get_id())
+    {
+        innermost_ = this;
+        Instrumentor::RegisterInstrumentation(this);
+        m_session_.AddMemoryProfiler(this);
+    }
+
+    /**
+     * Stop and destroy a memory profiling object.
+     */
+    ~InstrumentationMemory()
+    {
+        if (!m_stopped_)
+            Stop();
+        // Stop only unlinks on the owning thread, a profiler stopped from elsewhere is still linked.
+        Unlink();
+    }
+
+    /**
+     * Get the innermost memory profiler started by the calling thread.
+     * @return Pointer to the innermost memory profiler of the calling thread, nullptr if it didn't start any
+     */
+    static InstrumentationMemory* GetInnermost()
+    {
+        return innermost_;
+    }
+
+    /**
+     * Stop a profiler manually. Under normal conditions it should not be necessary.
+     */
+    void Stop()
+    {
+        ProfileLock lock;
+        if (m_stopped_.exchange(true))
+            return;
+
+        Instrumentor::UnregisterInstrumentation(this);
+        m_session_.RemoveMemoryProfiler(this);
+        // Threads that looked this profiler up before it got unregistered may still be recording into it.
+        MemoryUseGuard::WaitForUsers();
+        Unlink();
+        StopPublishing();
+        StopSampling();
+        m_eventRing_.store(nullptr, std::memory_order_release);
+
+        // Streaming profilers already wrote everything, what is still live gets reported as leaked on analysis.
+        if (m_mode_ == MemoryProfileMode::FULL || m_mode_ == MemoryProfileMode::SAMPLED)
+        {
+            for (auto& shard : m_shards_)
+            {
+                std::lock_guard shardLock(shard.mutex);
+                shard.results.ForEach([this](void*, const ProfileResult_Memory& profileResult)
+                {
+                    m_session_.WriteProfile(profileResult);
+                });
+            }
+        }
+
+        SettlePeak();
+        m_session_.WriteProfile(MergeCounters());
+        WritePeakSnapshot();
+
+        // std::cout << "Profiling stopped\n";
+    }
+
+    /**
+     * Check whether the live bytes of every thread added up went past the highest peak seen so far. A new peak is
+     * queued to the session if it grew enough since the last one, and every thread saves what it had live the next
+     * time it allocates or deallocates. The writer thread of the session calls this every few milliseconds, so the
+     * allocation path only ever touches the counters of its own thread.
+     */
+    void ObservePeak()
+    {
+        long long live = 0;
+        {
+            std::lock_guard countersLock(m_threadCountersMutex_);
+            for (const auto& counters : m_threadCounters_)
+            {
+                live += LiveBytes(*counters);
+            }
+        }
+
+        long long peak = m_peakBytes_.load(std::memory_order_relaxed);
+        while (live > peak && !m_peakBytes_.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+        // Only the caller whose exchange succeeded still sees the old peak below live
+        if (live <= peak)
+        {
+            return;
+        }
+
+        const long long now = ProfileClock::Now();
+        m_peakTime_.store(now, std::memory_order_relaxed);
+        m_peakNumber_.fetch_add(1, std::memory_order_relaxed);
+
+        long long reported = m_reportedPeakBytes_.load(std::memory_order_relaxed);
+        if (live - reported <= reported / peakGrowthDivisor ||
+            !m_reportedPeakBytes_.compare_exchange_strong(reported, live, std::memory_order_relaxed))
+        {
+            return;
+        }
+        m_session_.WritePeak(m_peakName_, now, static_cast<uint64_t>(live));
+    }
+
+    /**
+     * Start publishing the live counters of this profiler into a shared memory segment, see profiler_shm.h for its
+     * layout. A background thread merges the per-thread counters and publishes them every interval, readers never
+     * block the profiled program. The segment is removed when the profiler gets destroyed.
+     * @param segmentName Name of the segment, without any platform prefix. Readers open it with
+     * profiler_shm::SharedMemory::Open
+     * @param interval Time between two publications
+     * @throws error Errors if the segment can't be created or the counters are already being published
+     */
+    void PublishCounters(const std::string& segmentName,
+                         const std::chrono::milliseconds interval = defaultPublishInterval)
+    {
+        ProfileLock lock;
+        if (m_publisherThread_.joinable())
+        {
+            throw "The counters of this memory profiler are already being published";
+        }
+        if (!m_counterSegment_.Create(segmentName, sizeof(profiler_shm::CounterSegment)))
+        {
+            throw "The shared memory segment for the live counters couldn't be created";
+        }
+
+        auto* segment = static_cast<profiler_shm::CounterSegment*>(m_counterSegment_.Data());
+        profiler_shm::InitializeCounters(*segment, static_cast<uint32_t>(interval.count()));
+        m_publisherRunning_ = true;
+        m_publisherThread_ = std::thread(&InstrumentationMemory::PublisherLoop, this, segment, interval);
+    }
+
+    /**
+     * Start writing samples of the live bytes and live allocations into the trace as counter events, so trace viewers
+     * can plot heap usage over time. A background thread merges the per-thread counters every interval, the allocation
+     * path doesn't do anything more than it already did. A last sample is written when the profiler stops.
+     * @param interval Time between two samples
+     * @throws error Errors if the counters are already being sampled
+     */
+    void SampleCounters(const std::chrono::milliseconds interval = defaultCounterInterval)
+    {
+        ProfileLock lock;
+        if (m_samplerThread_.joinable())
+        {
+            throw "The counters of this memory profiler are already being sampled";
+        }
+
+        m_samplerRunning_ = true;
+        m_samplerThread_ = std::thread(&InstrumentationMemory::SamplerLoop, this, interval);
+    }
+
+    /**
+     * Add up what every thread allocated so far, without the rest of the summary.
+     * @param allocations Receives the amount of allocations
+     * @param bytesAllocated Receives the amount of bytes allocated
+     */
+    void GetAllocationTotals(uint64_t& allocations, uint64_t& bytesAllocated) const
+    {
+        allocations = 0;
+        bytesAllocated = 0;
+        std::lock_guard countersLock(m_threadCountersMutex_);
+        for (const auto& counters : m_threadCounters_)
+        {
+            allocations += counters->allocations.load(std::memory_order_relaxed);
+            bytesAllocated += counters->bytesAllocated.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Start publishing every allocation and deallocation into a shared memory ring, see profiler_shm.h for its layout.
+     * A viewer attached to the segment picks the events up while the program runs. Publishing never waits: when the
+     * ring is full the event is dropped and counted in the segment. The segment is removed when the profiler gets
+     * destroyed.
+     * @param segmentName Name of the segment, without any platform prefix. Readers open it with
+     * profiler_shm::OpenEvents
+     * @param capacity Amount of slots, rounded up to a power of two
+     * @throws error Errors if the segment can't be created or the events are already being published
+     */
+    void PublishEvents(const std::string& segmentName, const uint32_t capacity = defaultEventCapacity)
+    {
+        ProfileLock lock;
+        if (m_eventRing_.load(std::memory_order_relaxed) != nullptr)
+        {
+            throw "The events of this memory profiler are already being published";
+        }
+
+        const uint32_t slots = std::bit_ceil(std::max(capacity, 2u));
+        if (!m_eventSegment_.Create(segmentName, profiler_shm::EventRingSize(slots)))
+        {
+            throw "The shared memory segment for the live events couldn't be created";
+        }
+
+        auto* ring = static_cast<profiler_shm::EventRing*>(m_eventSegment_.Data());
+        profiler_shm::InitializeEvents(*ring, slots, ProfileClock::TicksPerSecond());
+        m_eventRing_.store(ring, std::memory_order_release);
+    }
+
+    /**
+     * Register when memory gets allocated.
+     * @param address Memory address of the memory being allocated
+     * @param size size of the memory being allocated
+     * @param isArray boolean indicating whether the memory was allocated for an array
+     * @param alignment Alignment requested through std::align_val_t, 0 for the default alignment
+     */
+    void Register_push(void* address, const size_t size, const bool isArray, const size_t alignment = 0)
+    {
+        if (m_stopped_.load() || address == nullptr) return;
+        // Read before counting, so a peak this allocation makes still counts it as live at that peak.
+        const uint64_t peakNumber = m_peakNumber_.load(std::memory_order_relaxed);
+        const size_t countedSize = AllocationSize(address, alignment);
+        ThreadCounters& counters = CountAllocation(countedSize, peakNumber);
+        // Blocks that aren't sampled only show up in the totals, nothing else gets looked at for them.
+        if (m_mode_ == MemoryProfileMode::SAMPLED && !ShouldSample(size)) return;
+
+        const double sampleWeight = m_mode_ == MemoryProfileMode::SAMPLED ? SampleWeight(size) : 1.0;
+        const CallSite* scope = InstrumentationTimer::GetCurrentScope();
+        if (scope != nullptr)
+        {
+            CountScopeAllocation(counters, *scope, std::llround(sampleWeight),
+                                 std::llround(sampleWeight * static_cast<double>(countedSize)));
+        }
+        PublishEvent(profiler_shm::EVENT::ALLOCATION, address, size);
+        if (m_mode_ == MemoryProfileMode::AGGREGATE) return;
+
+        // Capture everything before taking the shard lock, the stack trace is by far the slowest part.
+        ProfileResult_Memory result = {
+            .isArray = isArray,
+            .threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())),
+            .location = address,
+            .size = size,
+            .stackDepth = 0,
+            .stackFrames = {},
+            .start = ProfileClock::Now(),
+            .sampleWeight = sampleWeight,
+            .scope = scope
+        };
+
+        // Only the addresses are kept, resolving symbols here would dominate the cost of every allocation.
+        for (const auto& entry : std::stacktrace::current(0, ProfileResult_Memory::maxStackDepth))
+        {
+            result.stackFrames[result.stackDepth++] = entry;
+        }
+
+        Shard& shard = GetShard(address);
+        {
+            std::lock_guard shardLock(shard.mutex);
+            shard.results.Insert(address) = result;
+        }
+        UpdateSite(result, countedSize, 1, peakNumber);
+
+        if (m_mode_ == MemoryProfileMode::STREAMING)
+        {
+            m_session_.WriteAllocationEvent(result);
+        }
+    }
+
+
+    /**
+     * Register memory deallocation.
+     * @param address The address of the memory being deallocated.
+     * @param alignment Alignment requested through std::align_val_t, 0 for the default alignment
+     */
+    void Register_pop(void* address, const size_t alignment = 0)
+    {
+        // Aggregating and sampling don't know about every block, the innermost profiler counts the free. The block
+        // still gets looked up below, an outer profiler may have recorded it.
+        if (m_mode_ == MemoryProfileMode::AGGREGATE || m_mode_ == MemoryProfileMode::SAMPLED)
+        {
+            if (!m_stopped_.load())
+            {
+                CountDeallocation(AllocationSize(address, alignment), m_peakNumber_.load(std::memory_order_relaxed));
+                // Sampled profilers only published the blocks they sampled, Release publishes those.
+                if (m_mode_ == MemoryProfileMode::AGGREGATE)
+                {
+                    PublishEvent(profiler_shm::EVENT::DEALLOCATION, address, 0);
+                }
+            }
+        }
+
+        const long long end = ProfileClock::Now();
+
+        InstrumentationMemory* root = Instrumentor::GetRootMemoryInstrumentation();
+        for (InstrumentationMemory* scope = this; scope != nullptr; scope = scope->m_parent_)
+        {
+            if (scope->Release(address, alignment, end))
+                return;
+            if (scope == root)
+                root = nullptr;
+        }
+
+        // Allocated by a thread that used the root profiler
+        if (root != nullptr)
+            root->Release(address, alignment, end);
+    }
+
+private:
+    /**
+     * Mark a block recorded by this profiler as deallocated.
+     * @param address The address of the memory being deallocated
+     * @param alignment Alignment requested through std::align_val_t, 0 for the default alignment
+     * @param end Time stamp of the deallocation
+     * @return Whether the block was recorded by this profiler
+     */
+    bool Release(void* address, const size_t alignment, const long long end)
+    {
+        if (m_stopped_.load() || m_mode_ == MemoryProfileMode::AGGREGATE) return false;
+
+        Shard& shard = GetShard(address);
+        if (m_mode_ == MemoryProfileMode::STREAMING)
+        {
+            ProfileResult_Memory allocation;
+            {
+                std::lock_guard shardLock(shard.mutex);
+                const ProfileResult_Memory* findResult = shard.results.Find(address);
+                if (findResult == nullptr)
+                    return false; // Allocated before the profiler started or by another one
+                allocation = *findResult;
+                shard.results.Erase(address);
+            }
+            const uint64_t peakNumber = m_peakNumber_.load(std::memory_order_relaxed);
+            const size_t countedSize = AllocationSize(address, alignment);
+            UpdateSite(allocation, countedSize, -1, peakNumber);
+
+            CountDeallocation(countedSize, peakNumber);
+            PublishEvent(profiler_shm::EVENT::DEALLOCATION, address, 0);
+            // Written before the block goes back to malloc so a reuse of the address can't be written before this.
+            const uint32_t threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            m_session_.WriteDeallocationEvent(address, threadId, end);
+            return true;
+        }
+
+        ProfileResult_Memory allocation;
+        {
+            std::lock_guard shardLock(shard.mutex);
+            // This used to explode after closing the window, but it doesn't anymore.
+            // I(danybeam) cannot get it to reproduce anymore. If someone can  please fill up an issue in the repo.
+            ProfileResult_Memory* findResult = shard.results.Find(address);
+            // A block that is already deallocated is an older allocation at the same address
+            if (findResult == nullptr || findResult->end >= 0)
+                return false;
+            findResult->end = end;
+            allocation = *findResult;
+        }
+        const uint64_t peakNumber = m_peakNumber_.load(std::memory_order_relaxed);
+        const size_t countedSize = AllocationSize(address, alignment);
+        UpdateSite(allocation, countedSize, -1, peakNumber);
+
+        // Sampled profilers counted it already, unsampled blocks never get here.
+        if (m_mode_ == MemoryProfileMode::FULL)
+        {
+            CountDeallocation(countedSize, peakNumber);
+        }
+        PublishEvent(profiler_shm::EVENT::DEALLOCATION, address, 0);
+        return true;
+    }
+
+    /**
+     * Publish an event into the ring, if PublishEvents was called.
+     * @param kind Whether the block got allocated or deallocated
+     * @param address Address of the block
+     * @param size Requested size of the allocation, 0 for deallocations
+     */
+    void PublishEvent(const profiler_shm::EVENT kind, void* address, const size_t size)
+    {
+        profiler_shm::EventRing* ring = m_eventRing_.load(std::memory_order_acquire);
+        if (ring == nullptr)
+            return;
+
+        profiler_shm::PushEvent(*ring, {
+                                    .address = reinterpret_cast<uint64_t>(address),
+                                    .size = size,
+                                    .timestamp = ProfileClock::Now(),
+                                    .threadId = static_cast<uint32_t>(std::hash<std::thread::id>{}(
+                                        std::this_thread::get_id())),
+                                    .kind = kind
+                                });
+    }
+
+    /**
+     * Body of the publisher thread. Publishes a snapshot every interval and a last one when the profiler stops.
+     * @param segment Mapped counters segment
+     * @param interval Time between two publications
+     */
+    void PublisherLoop(profiler_shm::CounterSegment* segment, const std::chrono::milliseconds interval)
+    {
+        ProfileLock lock;
+        auto previousTime = std::chrono::steady_clock::now();
+        ProfileResult_MemorySummary previous;
+        bool running = true;
+        while (running)
+        {
+            {
+                std::unique_lock publisherLock(m_publisherMutex_);
+                running = !m_publisherWake_.wait_for(publisherLock, interval, [this] { return !m_publisherRunning_; });
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            const ProfileResult_MemorySummary summary = MergeCounters();
+            const double seconds = std::chrono::duration<double>(now - previousTime).count();
+
+            profiler_shm::LiveCounters counters;
+            counters.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now.time_since_epoch()).count());
+            counters.liveBytes = summary.LiveBytes();
+            counters.peakBytes = summary.peakBytes;
+            counters.allocations = summary.allocations;
+            counters.deallocations = summary.deallocations;
+            counters.bytesAllocated = summary.bytesAllocated;
+            counters.bytesDeallocated = summary.bytesDeallocated;
+            if (seconds > 0)
+            {
+                counters.allocationsPerSecond = static_cast<double>(summary.allocations - previous.allocations) / seconds;
+                counters.deallocationsPerSecond =
+                    static_cast<double>(summary.deallocations - previous.deallocations) / seconds;
+            }
+            profiler_shm::PublishCounters(*segment, counters);
+
+            previous = summary;
+            previousTime = now;
+        }
+    }
+
+    /**
+     * Body of the sampler thread. Writes the live counters into the trace every interval until the profiler stops.
+     * @param interval Time between two samples
+     */
+    void SamplerLoop(const std::chrono::milliseconds interval)
+    {
+        ProfileLock lock;
+        bool running = true;
+        uint64_t previousAllocations = UINT64_MAX;
+        uint64_t previousDeallocations = UINT64_MAX;
+        while (running)
+        {
+            {
+                std::unique_lock samplerLock(m_samplerMutex_);
+                running = !m_samplerWake_.wait_for(samplerLock, interval, [this] { return !m_samplerRunning_; });
+            }
+
+            // An idle heap would only repeat the last sample, the final one is always written to close the track.
+            const ProfileResult_MemorySummary summary = MergeCounters();
+            if (running && summary.allocations == previousAllocations && summary.deallocations == previousDeallocations)
+            {
+                continue;
+            }
+
+            const uint64_t liveBytes = static_cast<uint64_t>(std::max(summary.LiveBytes(), 0ll));
+            const uint64_t liveAllocations =
+                summary.allocations > summary.deallocations ? summary.allocations - summary.deallocations : 0;
+            m_session_.WriteCounters(m_name_, ProfileClock::Now(), liveBytes, liveAllocations);
+            previousAllocations = summary.allocations;
+            previousDeallocations = summary.deallocations;
+        }
+    }
+
+    /**
+     * Stop the sampler thread if it is running.
+     */
+    void StopSampling()
+    {
+        if (!m_samplerThread_.joinable())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard samplerLock(m_samplerMutex_);
+            m_samplerRunning_ = false;
+        }
+        m_samplerWake_.notify_one();
+        m_samplerThread_.join();
+    }
+
+    /**
+     * Stop the publisher thread if it is running. The segment stays mapped with the last snapshot.
+     */
+    void StopPublishing()
+    {
+        if (!m_publisherThread_.joinable())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard publisherLock(m_publisherMutex_);
+            m_publisherRunning_ = false;
+        }
+        m_publisherWake_.notify_one();
+        m_publisherThread_.join();
+    }
+
+    /**
+     * Remove this profiler from the stack of the calling thread, if that is the thread that created it.
+     */
+    void Unlink()
+    {
+        if (std::this_thread::get_id() != m_ownerThread_)
+            return;
+
+        // Usually this is the innermost one, the walk only happens when profilers stop out of order.
+        InstrumentationMemory** link = &innermost_;
+        while (*link != nullptr && *link != this)
+            link = &(*link)->m_parent_;
+        if (*link == this)
+            *link = m_parent_;
+    }
+
+    /**
+     * Allocations of one thread inside one timer scope.
+     */
+    struct ScopeCounters
+    {
+        std::atomic<const CallSite*> callSite = nullptr; /**< Call site of the scope, nullptr until it allocates. */
+        std::atomic<uint64_t> allocations = 0; /**< How many allocations happened in the scope. */
+        std::atomic<uint64_t> bytesAllocated = 0; /**< Total bytes allocated in the scope. */
+    };
+
+    /**
+     * Amount of scope counters allocated together, indexed by call site ID.
+     */
+    static constexpr size_t scopeBlockSize = 64;
+
+    /**
+     * Amount of blocks of scope counters a thread can have. Scopes with higher call site IDs aren't counted.
+     */
+    static constexpr size_t scopeBlockCount = 256;
+
+    /**
+     * Live totals of one call site, as seen by one thread.
+     */
+    struct LiveSite
+    {
+        ProfileResult_Memory allocation; /**< First allocation seen from the site, its stack identifies the site. */
+        long long bytes = 0; /**< Bytes allocated from the site that are still live. */
+        long long count = 0; /**< Allocations from the site that are still live. */
+        long long bytesAtPeak = 0; /**< bytes when peak number peakNumber was reached. */
+        long long countAtPeak = 0; /**< count when peak number peakNumber was reached. */
+        uint64_t peakNumber = 0; /**< Peak the totals were last saved for, bytes and count only changed since. */
+    };
+
+    /**
+     * Counters of one thread. Only the owning thread writes them, the atomics are there so Stop can read them safely.
+     * Aligned to a cache line so that counters of different threads don't false share.
+     */
+    struct alignas(64) ThreadCounters
+    {
+        std::thread::id thread; /**< Thread owning the counters. */
+        std::atomic<uint64_t> allocations = 0; /**< How many allocations happened. */
+        std::atomic<uint64_t> deallocations = 0; /**< How many deallocations happened. */
+        std::atomic<uint64_t> bytesAllocated = 0; /**< Total bytes allocated. */
+        std::atomic<uint64_t> bytesDeallocated = 0; /**< Total bytes deallocated. */
+        std::array<std::atomic<uint64_t>, ProfileResult_MemorySummary::histogramBuckets> allocationHistogram = {};
+        /**< Allocations per log2 size class. */
+        std::array<std::atomic<uint64_t>, ProfileResult_MemorySummary::histogramBuckets> deallocationHistogram = {};
+        /**< Deallocations per log2 size class. */
+        std::array<std::atomic<ScopeCounters*>, scopeBlockCount> scopeBlocks = {};
+        /**< Counters per timer scope, in blocks that are never moved once built so readers don't need a lock. */
+        long long liveBytesAtPeak = 0; /**< Live bytes when peak number peakNumber was reached. Only read at Stop. */
+        uint64_t peakNumber = 0; /**< Peak liveBytesAtPeak was last saved for, the live bytes only changed since. */
+        AddressTable<LiveSite> sites;
+        /**< Live totals of the call sites this thread allocated or deallocated from, keyed by SiteKey. Only read once
+         * the profiler stopped. */
+
+        /**
+         * Free the blocks of scope counters.
+         */
+        ~ThreadCounters()
+        {
+            for (const auto& scopes : scopeBlocks)
+            {
+                delete[] scopes.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /**
+     * Add to a counter owned by the calling thread. No read-modify-write needed as nobody else writes it.
+     * @param counter Counter to bump
+     * @param amount Amount to add
+     */
+    static void Bump(std::atomic<uint64_t>& counter, const uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the counters of the calling thread, registering them the first time this thread allocates.
+     * @return Reference to the counters of the calling thread
+     */
+    ThreadCounters& GetThreadCounters()
+    {
+        return GetThreadEntry(m_id_, m_threadCounters_, m_threadCountersMutex_, &ThreadCounters::thread);
+    }
+
+    /**
+     * Get the live bytes counted by one thread.
+     * @param counters Counters of the thread
+     * @return Bytes it allocated minus the bytes it deallocated, negative if it freed blocks of other threads
+     */
+    static long long LiveBytes(const ThreadCounters& counters)
+    {
+        return static_cast<long long>(counters.bytesAllocated.load(std::memory_order_relaxed)) -
+            static_cast<long long>(counters.bytesDeallocated.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Save the live bytes of the calling thread if this is its first change since a new peak was observed.
+     * @param counters Counters of the calling thread
+     * @param peakNumber Value of m_peakNumber_ when the change happened
+     */
+    static void SavePeakLiveBytes(ThreadCounters& counters, const uint64_t peakNumber)
+    {
+        if (counters.peakNumber != peakNumber) [[unlikely]]
+        {
+            counters.liveBytesAtPeak = LiveBytes(counters);
+            counters.peakNumber = peakNumber;
+        }
+    }
+
+    /**
+     * Count an allocation in the counters of the calling thread.
+     * @param size Usable size of the block
+     * @param peakNumber Value of m_peakNumber_ when the allocation happened
+     * @return The counters of the calling thread
+     */
+    ThreadCounters& CountAllocation(const size_t size, const uint64_t peakNumber)
+    {
+        ThreadCounters& counters = GetThreadCounters();
+        SavePeakLiveBytes(counters, peakNumber);
+        Bump(counters.allocations, 1);
+        Bump(counters.bytesAllocated, size);
+        Bump(counters.allocationHistogram[std::bit_width(size) % ProfileResult_MemorySummary::histogramBuckets], 1);
+        return counters;
+    }
+
+    /**
+     * Count an allocation in the counters of its timer scope.
+     * @param counters Counters of the calling thread
+     * @param scope Innermost timer scope of the calling thread
+     * @param allocations Allocations the block stands for, more than 1 for sampled blocks
+     * @param bytes Usable bytes the block stands for
+     */
+    static void CountScopeAllocation(ThreadCounters& counters, const CallSite& scope, const long long allocations,
+                                     const long long bytes)
+    {
+        const size_t block = scope.GetId() / scopeBlockSize;
+        if (block >= scopeBlockCount) [[unlikely]]
+        {
+            return;
+        }
+
+        ScopeCounters* scopes = counters.scopeBlocks[block].load(std::memory_order_relaxed);
+        if (scopes == nullptr)
+        {
+            // Published after being built so MergeCounters never sees a half constructed block.
+            scopes = new ScopeCounters[scopeBlockSize];
+            counters.scopeBlocks[block].store(scopes, std::memory_order_release);
+        }
+
+        ScopeCounters& scopeCounters = scopes[scope.GetId() % scopeBlockSize];
+        if (scopeCounters.callSite.load(std::memory_order_relaxed) == nullptr)
+        {
+            scopeCounters.callSite.store(&scope, std::memory_order_relaxed);
+        }
+        Bump(scopeCounters.allocations, static_cast<uint64_t>(allocations));
+        Bump(scopeCounters.bytesAllocated, static_cast<uint64_t>(bytes));
+    }
+
+    /**
+     * Count a deallocation in the counters of the calling thread.
+     * @param size Usable size of the block
+     * @param peakNumber Value of m_peakNumber_ when the deallocation happened
+     */
+    void CountDeallocation(const size_t size, const uint64_t peakNumber)
+    {
+        ThreadCounters& counters = GetThreadCounters();
+        SavePeakLiveBytes(counters, peakNumber);
+        Bump(counters.deallocations, 1);
+        Bump(counters.bytesDeallocated, size);
+        Bump(counters.deallocationHistogram[std::bit_width(size) % ProfileResult_MemorySummary::histogramBuckets], 1);
+    }
+
+    /**
+     * Work out the live bytes at the last peak from what every thread had at it. Counters that changed since saved
+     * what they had, the others still have it. Only call it once no thread records into the profiler anymore.
+     */
+    void SettlePeak()
+    {
+        // What is live now may be higher than anything the writer thread saw.
+        ObservePeak();
+        const uint64_t peakNumber = m_peakNumber_.load(std::memory_order_relaxed);
+        if (peakNumber == 0)
+        {
+            return;
+        }
+
+        long long peak = 0;
+        {
+            std::lock_guard countersLock(m_threadCountersMutex_);
+            for (const auto& counters : m_threadCounters_)
+            {
+                peak += counters->peakNumber == peakNumber ? counters->liveBytesAtPeak : LiveBytes(*counters);
+            }
+        }
+        m_peakBytes_.store(peak, std::memory_order_relaxed);
+    }
+
+    /**
+     * Write the peak settled by SettlePeak, and what was live at it by adding up the call sites of every thread.
+     * Nothing is written if nothing was allocated. Aggregate profilers only write the peak, they have no call sites.
+     * Only call it once no thread records into the profiler anymore.
+     */
+    void WritePeakSnapshot()
+    {
+        const long long peak = m_peakBytes_.load(std::memory_order_relaxed);
+        if (peak == 0)
+        {
+            return;
+        }
+        const long long peakTime = m_peakTime_.load(std::memory_order_relaxed);
+        if (peak != m_reportedPeakBytes_.load(std::memory_order_relaxed))
+        {
+            m_session_.WritePeak(m_peakName_, peakTime, static_cast<uint64_t>(peak));
+        }
+        if (m_mode_ == MemoryProfileMode::AGGREGATE)
+        {
+            return;
+        }
+
+        // A site changed since the last peak saved what it had at it, one that didn't still has it.
+        const uint64_t peakNumber = m_peakNumber_.load(std::memory_order_relaxed);
+        AddressTable<LiveSite> sites;
+        {
+            std::lock_guard countersLock(m_threadCountersMutex_);
+            for (const auto& counters : m_threadCounters_)
+            {
+                counters->sites.ForEach([&sites, peakNumber](void* key, const LiveSite& site)
+                {
+                    LiveSite& merged = sites.Insert(key);
+                    merged.allocation = site.allocation;
+                    merged.bytes += site.peakNumber == peakNumber ? site.bytesAtPeak : site.bytes;
+                    merged.count += site.peakNumber == peakNumber ? site.countAtPeak : site.count;
+                });
+            }
+        }
+
+        ProfileResult_PeakSnapshot snapshot;
+        snapshot.name = m_name_;
+        snapshot.timestamp = peakTime;
+        snapshot.liveBytes = static_cast<uint64_t>(peak);
+        sites.ForEach([&snapshot](void*, const LiveSite& site)
+        {
+            if (site.bytes > 0)
+            {
+                snapshot.sites.push_back({
+                    site.allocation, static_cast<uint64_t>(site.bytes), static_cast<uint64_t>(site.count)
+                });
+            }
+        });
+        std::ranges::sort(snapshot.sites, std::greater{}, &ProfileResult_PeakSite::bytes);
+
+        m_session_.WriteProfile(snapshot);
+    }
+
+    /**
+     * Add up the counters of every thread.
+     * @return The summary of the whole profiling
+     */
+    ProfileResult_MemorySummary MergeCounters()
+    {
+        ProfileResult_MemorySummary summary;
+        summary.name = m_name_;
+
+        // Ordered by call site ID, so the scopes come out sorted
+        std::map<uint32_t, ProfileResult_ScopeSummary> scopes;
+
+        std::lock_guard countersLock(m_threadCountersMutex_);
+        for (const auto& counters : m_threadCounters_)
+        {
+            for (const auto& block : counters->scopeBlocks)
+            {
+                const ScopeCounters* scopeCounters = block.load(std::memory_order_acquire);
+                for (size_t i = 0; scopeCounters != nullptr && i < scopeBlockSize; i++)
+                {
+                    const CallSite* callSite = scopeCounters[i].callSite.load(std::memory_order_relaxed);
+                    if (callSite == nullptr)
+                        continue;
+
+                    ProfileResult_ScopeSummary& scope = scopes[callSite->GetId()];
+                    scope.callSite = callSite;
+                    scope.allocations += scopeCounters[i].allocations.load(std::memory_order_relaxed);
+                    scope.bytesAllocated += scopeCounters[i].bytesAllocated.load(std::memory_order_relaxed);
+                }
+            }
+
+            summary.allocations += counters->allocations.load(std::memory_order_relaxed);
+            summary.deallocations += counters->deallocations.load(std::memory_order_relaxed);
+            summary.bytesAllocated += counters->bytesAllocated.load(std::memory_order_relaxed);
+            summary.bytesDeallocated += counters->bytesDeallocated.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < ProfileResult_MemorySummary::histogramBuckets; i++)
+            {
+                summary.allocationHistogram[i] += counters->allocationHistogram[i].load(std::memory_order_relaxed);
+                summary.deallocationHistogram[i] += counters->deallocationHistogram[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        summary.peakBytes = static_cast<uint64_t>(std::max({m_peakBytes_.load(), summary.LiveBytes(), 0ll}));
+        summary.scopes.reserve(scopes.size());
+        for (const auto& scope : scopes | std::views::values)
+        {
+            summary.scopes.push_back(scope);
+        }
+        return summary;
+    }
+
+    /**
+     * Count down the bytes until the next sample of the calling thread.
+     * @remark The countdown is drawn from an exponential distribution with mean m_sampleInterval_, which picks an
+     * allocation with probability 1 - exp(-size / m_sampleInterval_). SampleWeight undoes that bias.
+     * @param size size of the memory being allocated
+     * @return Whether this allocation should be recorded
+     */
+    bool ShouldSample(const size_t size) const
+    {
+        thread_local int64_t bytesUntilSample = 0;
+        thread_local uint64_t randomState = 0;
+
+        bytesUntilSample -= static_cast<int64_t>(size);
+        if (bytesUntilSample > 0) [[likely]]
+        {
+            return false;
+        }
+
+        if (randomState == 0) [[unlikely]]
+        {
+            // First allocation of the thread. Draw an interval instead of always sampling it.
+            randomState = std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+            bytesUntilSample = NextSampleInterval(randomState) - static_cast<int64_t>(size);
+            if (bytesUntilSample > 0)
+            {
+                return false;
+            }
+        }
+
+        bytesUntilSample = NextSampleInterval(randomState);
+        return true;
+    }
+
+    /**
+     * Draw the amount of bytes until the next sample.
+     * @param randomState State of the calling thread's random generator
+     * @return Bytes until the next sample, exponentially distributed with mean m_sampleInterval_
+     */
+    int64_t NextSampleInterval(uint64_t& randomState) const
+    {
+        // xorshift64*, enough quality for this and it doesn't allocate
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        const uint64_t random = randomState * 0x2545F4914F6CDD1Dull;
+
+        // Top 53 bits as a double in (0, 1]
+        const double uniform = static_cast<double>((random >> 11) + 1) * 0x1.0p-53;
+        return static_cast<int64_t>(-std::log(uniform) * m_sampleInterval_) + 1;
+    }
+
+    /**
+     * Get the inverse of the probability of an allocation to be sampled.
+     * @param size size of the memory being allocated
+     * @return How many allocations of this size a sample stands for
+     */
+    double SampleWeight(const size_t size) const
+    {
+        return 1.0 / -std::expm1(-static_cast<double>(size) / m_sampleInterval_);
+    }
+
+    /**
+     * Amount of shards the allocations are split into. Must be a power of two.
+     */
+    static constexpr size_t shardCount = 64;
+
+    /**
+     * A slice of the tracked allocations with its own lock.
+     * Aligned to a cache line so that neighbouring shards don't false share.
+     */
+    struct alignas(64) Shard
+    {
+        std::mutex mutex; /**< Lock protecting the results of this shard. */
+        AddressTable<ProfileResult_Memory> results; /**< Allocations that hashed into this shard. */
+    };
+
+    /**
+     * A new high-water mark is only written once the peak grew by more than 1/peakGrowthDivisor of the last one.
+     */
+    static constexpr long long peakGrowthDivisor = 64;
+
+    /**
+     * Find the shard an address belongs to.
+     * @param address The address of the allocation
+     * @return Reference to the shard owning the address
+     */
+    Shard& GetShard(void* address)
+    {
+        // Drop the low bits that are always zero because of malloc alignment, then mix the rest.
+        uintptr_t hash = reinterpret_cast<uintptr_t>(address) >> 4;
+        hash ^= hash >> 17;
+        hash *= 0x9E3779B97F4A7C15ull;
+        return m_shards_[(hash >> 32) & (shardCount - 1)];
+    }
+
+    /**
+     * Get the key of the call site of an allocation.
+     * @param allocation The allocation, with its stack captured
+     * @return A hash of the stack, never nullptr so it can key an AddressTable
+     */
+    static void* SiteKey(const ProfileResult_Memory& allocation)
+    {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < allocation.stackDepth; i++)
+        {
+            hash ^= static_cast<uint64_t>(allocation.stackFrames[i].native_handle());
+            hash *= 0x100000001B3ull;
+        }
+        return reinterpret_cast<void*>(static_cast<uintptr_t>(hash | 1));
+    }
+
+    /**
+     * Add or remove an allocation from the live totals of its call site, in the sites of the calling thread. A block
+     * freed by another thread than the one that allocated it leaves a negative total there, they add up when merged.
+     * @param allocation The allocation, with its stack captured
+     * @param size Usable size of the block, the same size the counters got
+     * @param direction 1 when it gets allocated, -1 when it gets deallocated
+     * @param peakNumber Value of m_peakNumber_ when the change happened
+     */
+    void UpdateSite(const ProfileResult_Memory& allocation, const size_t size, const long long direction,
+                    const uint64_t peakNumber)
+    {
+        // Sampled records stand for several allocations
+        const long long bytes = std::llround(allocation.sampleWeight * static_cast<double>(size));
+        const long long count = std::llround(allocation.sampleWeight);
+
+        void* key = SiteKey(allocation);
+        ThreadCounters& counters = GetThreadCounters();
+        LiveSite* site = counters.sites.Find(key);
+        if (site == nullptr)
+        {
+            site = &counters.sites.Insert(key);
+            site->allocation = allocation;
+        }
+        if (site->peakNumber != peakNumber)
+        {
+            site->bytesAtPeak = site->bytes;
+            site->countAtPeak = site->count;
+            site->peakNumber = peakNumber;
+        }
+        site->bytes += direction * bytes;
+        site->count += direction * count;
+    }
+
+    /**
+     * Shards to track the memory being allocated, deallocated and leaked.
+     */
+    std::array<Shard, shardCount> m_shards_;
+    /**
+     * Instrumentor the profiler writes into, picked when it gets created.
+     */
+    Instrumentor& m_session_;
+    /**
+     * Name of the memory profiler.
+     */
+    std::string m_name_;
+    /**
+     * Name of the memory profiler as a named call site of the session, queued peaks point at it.
+     */
+    const CallSite& m_peakName_;
+    /**
+     * Unique id of this profiler, used to tell thread_local caches apart.
+     */
+    uint64_t m_id_;
+    /**
+     * Source of unique ids for profilers.
+     */
+    static inline std::atomic<uint64_t> nextId_ = 1;
+    /**
+     * Counters of every thread that allocated while aggregating.
+     */
+    std::vector<std::unique_ptr<ThreadCounters>> m_threadCounters_;
+    /**
+     * Lock for registering new thread counters, the hot path never takes it.
+     */
+    mutable std::mutex m_threadCountersMutex_;
+    /**
+     * Highest amount of live bytes of every thread added up, exact once SettlePeak ran.
+     */
+    std::atomic<long long> m_peakBytes_ = 0;
+    /**
+     * How many times m_peakBytes_ was raised.
+     */
+    std::atomic<uint64_t> m_peakNumber_ = 0;
+    /**
+     * When m_peakBytes_ was last raised, in ProfileClock ticks.
+     */
+    std::atomic<long long> m_peakTime_ = 0;
+    /**
+     * Live bytes of the last high-water mark written.
+     */
+    std::atomic<long long> m_reportedPeakBytes_ = 0;
+    /**
+     * How allocations get recorded.
+     */
+    MemoryProfileMode m_mode_;
+    /**
+     * Mean amount of bytes between samples.
+     */
+    double m_sampleInterval_;
+    /**
+     * Whether the profiler is stopped. It should be false during the normal operation of the profiler.
+     */
+    std::atomic<bool> m_stopped_;
+    /**
+     * Shared memory segment the live counters are published into, unmapped until PublishCounters is called.
+     */
+    profiler_shm::SharedMemory m_counterSegment_;
+    /**
+     * Background thread publishing the live counters.
+     */
+    std::thread m_publisherThread_;
+    /**
+     * Mutex paired with the publisher wake condition.
+     */
+    std::mutex m_publisherMutex_;
+    /**
+     * Used to wake the publisher when the profiler stops.
+     */
+    std::condition_variable m_publisherWake_;
+    /**
+     * Whether the publisher thread should keep publishing.
+     */
+    bool m_publisherRunning_ = false;
+    /**
+     * Background thread writing counter samples into the trace.
+     */
+    std::thread m_samplerThread_;
+    /**
+     * Mutex paired with the sampler wake condition.
+     */
+    std::mutex m_samplerMutex_;
+    /**
+     * Used to wake the sampler when the profiler stops.
+     */
+    std::condition_variable m_samplerWake_;
+    /**
+     * Whether the sampler thread should keep sampling.
+     */
+    bool m_samplerRunning_ = false;
+    /**
+     * Shared memory segment the live events are published into, unmapped until PublishEvents is called.
+     */
+    profiler_shm::SharedMemory m_eventSegment_;
+    /**
+     * Ring inside the events segment, nullptr while the events aren't published.
+     */
+    std::atomic<profiler_shm::EventRing*> m_eventRing_ = nullptr;
+    /**
+     * Profiler that was the innermost one of the creating thread when this one started.
+     */
+    InstrumentationMemory* m_parent_;
+    /**
+     * Thread that created the profiler, only its stack links to it.
+     */
+    std::thread::id m_ownerThread_;
+    /**
+     * Innermost profiler started by each thread, the top of its stack.
+     */
+    static inline thread_local InstrumentationMemory* innermost_ = nullptr;
+};
+
+inline InstrumentationMemory* Instrumentor::GetCurrentMemoryInstrumentation()
+{
+    if (InstrumentationMemory* innermost = InstrumentationMemory::GetInnermost())
+        return innermost;
+    return GetRootMemoryInstrumentation();
+}
+
+inline void Instrumentor::ObserveMemoryPeaks()
+{
+    std::lock_guard profilersLock(m_memoryProfilersMutex_);
+    for (InstrumentationMemory* memoryProfiler : m_memoryProfilers_)
+    {
+        memoryProfiler->ObservePeak();
+    }
+}
+
+inline void Instrumentor::MarkFrame()
+{
+    if (!m_sessionRunning_.load(std::memory_order_relaxed))
+        return;
+
+    ProfileLock lock;
+    MemoryUseGuard memoryUse;
+    const long long now = ProfileClock::Now();
+    uint64_t allocations = 0;
+    uint64_t bytesAllocated = 0;
+    const InstrumentationMemory* memoryInstrumentation = GetCurrentMemoryInstrumentation();
+    if (memoryInstrumentation != nullptr)
+        memoryInstrumentation->GetAllocationTotals(allocations, bytesAllocated);
+
+    std::lock_guard frameLock(m_frameMutex_);
+    // The counters are cumulative, a frame that changed profilers can only count from the new one's start.
+    if (memoryInstrumentation != m_frameMemory_)
+    {
+        m_currentFrame_.allocations = 0;
+        m_currentFrame_.bytesAllocated = 0;
+    }
+
+    if (m_currentFrame_.number > 0)
+    {
+        WriteProfile(ProfileResult_Frame{
+            .number = m_currentFrame_.number,
+            .start = m_currentFrame_.start,
+            .end = now,
+            .allocations = allocations - m_currentFrame_.allocations,
+            .bytesAllocated = bytesAllocated - m_currentFrame_.bytesAllocated
+        });
+    }
+
+    m_currentFrame_ = {
+        .number = m_currentFrame_.number + 1,
+        .start = now,
+        .allocations = allocations,
+        .bytesAllocated = bytesAllocated
+    };
+    m_frameMemory_ = memoryInstrumentation;
+}
+
+#if PROFILE
+/*
+ * These functions have been left uncommented somewhat on purpose.
+ * Here's the official documentation for the new operators. https://en.cppreference.com/w/cpp/memory/new/operator_new
+ * Here's the official documentation for the delete operators. https://en.cppreference.com/w/cpp/memory/new/operator_delete.html
+ *
+ * These functions try to do the same things but injecting the profiling tools into them.
+ * Every overload goes through ProfiledAllocate and ProfiledFree so plain, nothrow, sized and aligned forms are all
+ * recorded the same way.
+ */
+
+/**
+ * Allocate a block and hand it to the current memory profiler.
+ * @param size Requested size
+ * @param isArray Whether the block is for an array
+ * @param alignment Requested alignment, 0 for the default one
+ * @return The block, nullptr if it couldn't be allocated
+ */
+inline void* ProfiledAllocate(size_t size, const bool isArray, const size_t alignment) noexcept
+{
+    if (size == 0)
+    {
+        size++;
+    }
+
+    void* ptr = alignment == 0 ? std::malloc(size) : AlignedAllocate(size, alignment);
+
+    // Without a registered profiler there's nothing to guard, it only gets looked up again once guarded.
+    if (ptr != nullptr && ProfileLock::GetSaveProfiling() && Instrumentor::GetCurrentMemoryInstrumentation() != nullptr)
+    {
+        ProfileLock lock;
+        MemoryUseGuard memoryUse;
+        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
+            // Because there's no guarantee there will already be an instrumentor active
+            memoryInstrumentation->Register_push(ptr, size, isArray, alignment);
+    }
+    return ptr;
+}
+
+/**
+ * Hand a deallocation to the current memory profiler and release the block.
+ * @remark Sizes given to sized delete aren't used, the block is counted with the usable size it was allocated with.
+ * @param block The block to release
+ * @param alignment Alignment the block was allocated with, 0 for the default one
+ */
+inline void ProfiledFree(void* block, const size_t alignment) noexcept
+{
+    if (block == nullptr)
+    {
+        return;
+    }
+
+    if (ProfileLock::GetSaveProfiling() && Instrumentor::GetCurrentMemoryInstrumentation() != nullptr)
+    {
+        ProfileLock lock;
+        MemoryUseGuard memoryUse;
+        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
+            memoryInstrumentation->Register_pop(block, alignment);
+    }
+
+    if (alignment == 0)
+        std::free(block);
+    else
+        AlignedFree(block);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new(const size_t size)
+{
+    if (void* ptr = ProfiledAllocate(size, false, 0))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new[](const size_t size)
+{
+    if (void* ptr = ProfiledAllocate(size, true, 0))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new(const size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ProfiledAllocate(size, false, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new[](const size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ProfiledAllocate(size, true, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new(const size_t size, const std::align_val_t alignment)
+{
+    if (void* ptr = ProfiledAllocate(size, false, static_cast<size_t>(alignment)))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new[](const size_t size, const std::align_val_t alignment)
+{
+    if (void* ptr = ProfiledAllocate(size, true, static_cast<size_t>(alignment)))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new(const size_t size, const std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return ProfiledAllocate(size, false, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void* operator new[](const size_t size, const std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return ProfiledAllocate(size, true, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block, const std::nothrow_t& tag) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block, const std::nothrow_t& tag) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block, const size_t size) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block, const size_t size) noexcept
+{
+    ProfiledFree(block, 0);
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block, const std::align_val_t alignment) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block, const std::align_val_t alignment) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block, const std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block, const std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete(void* block, const size_t size, const std::align_val_t alignment) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+
+// ReSharper disable once CppInconsistentNaming
+inline void operator delete[](void* block, const size_t size, const std::align_val_t alignment) noexcept
+{
+    ProfiledFree(block, static_cast<size_t>(alignment));
+}
+#endif
+
+/*
+* These preprocessors are used to simplify the creation of the profiler objects.
+ */
+// The "if" preprocessor command and the macro commands are a mix of Cherno and danybeam (me)
+// Regardless of the copyright notice on modified versions of the code in the code the section bellow should be considered under the MIT license.
+// __LINE__ has to go through a second macro to be expanded before being pasted into the variable name.
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+#if PROFILE
+#define PROFILE_SCOPE_MEMORY(name) InstrumentationMemory PROFILER_CONCAT(memoryProfiler, __LINE__)(name)
+// The call site is static so its name has to be the same every time, use InstrumentationTimer directly for names that
+// change at runtime.
+#define PROFILE_SCOPE_TIME(name) \
+    static const CallSite PROFILER_CONCAT(callSite, __LINE__)(name, __FILE__, __LINE__); \
+    InstrumentationTimer PROFILER_CONCAT(timer, __LINE__)(PROFILER_CONCAT(callSite, __LINE__))
+#define PROFILE_FUNCTION_TIME() PROFILE_SCOPE_TIME(std::source_location::current().function_name())
+#define START_SESSION(name)  Instrumentor::Get().BeginSession(name)
+#define END_SESSION()  Instrumentor::Get().EndSession()
+#define PROFILE_FRAME_MARK() Instrumentor::Current().MarkFrame()
+#else
+#define PROFILE_SCOPE_MEMORY(name) static_cast<void>(0)
+#define PROFILE_SCOPE_TIME(name) static_cast<void>(0)
+#define PROFILE_FUNCTION_TIME() static_cast<void>(0)
+#define START_SESSION(name) static_cast<void>(0)
+#define END_SESSION() static_cast<void>(0)
+#define PROFILE_FRAME_MARK() static_cast<void>(0)
+#endif
+
+#pragma warning(pop)
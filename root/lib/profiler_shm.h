@@ -0,0 +1,596 @@
+//
+// Shared memory segments the profiler publishes live data through, so other processes can read it while the profiled
+// program keeps running without the program ever waiting on them.
+// Regardless of the copyright notice on modified versions of the code in the code this file should be considered under the MIT license.
+//
+// Counters segment (version 1), one per memory profiler that publishes its counters:
+//
+//     char     magic[4]         "MPVC"
+//     uint16_t version
+//     uint16_t reserved         always 0
+//     uint32_t processId        process publishing the counters
+//     uint32_t publishInterval  milliseconds between publications
+//     uint64_t sequence         seqlock, odd while the counters are being written
+//     uint64_t counters[]       LiveCounters, copied word by word
+//
+// There's a single writer per segment. Readers copy the counters and retry if the sequence was odd or changed in the
+// meantime, so they never block the writer and never see half written counters.
+//
+// Events segment (version 1), one per memory profiler that publishes its events:
+//
+//     char     magic[4]         "MPVR"
+//     uint16_t version
+//     uint16_t reserved         always 0
+//     uint32_t processId        process publishing the events
+//     uint32_t capacity         amount of slots, a power of two
+//     uint64_t ticksPerSecond   of the event timestamps
+//     uint64_t dropped          events thrown away because the ring was full
+//     uint64_t enqueuePosition  next slot to write, on its own cache line
+//     uint64_t dequeuePosition  next slot to read, on its own cache line
+//     EventSlot slots[capacity]
+//
+// The ring is a bounded multi-producer multi-consumer queue where every slot carries a sequence number telling whose
+// turn it is. Producers claim a slot with one compare-and-swap and never wait: when the ring is full the event is
+// counted in dropped and thrown away, so a slow or missing reader can't slow the profiled program down.
+//
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+// Declared by hand because windows.h clashes with raylib. These match the declarations in memoryapi.h, handleapi.h and
+// processthreadsapi.h.
+extern "C" __declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, void* attributes, unsigned long protect,
+                                                                    unsigned long maximumSizeHigh,
+                                                                    unsigned long maximumSizeLow, const char* name);
+extern "C" __declspec(dllimport) void* __stdcall OpenFileMappingA(unsigned long desiredAccess, int inheritHandle,
+                                                                  const char* name);
+extern "C" __declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long desiredAccess,
+                                                               unsigned long offsetHigh, unsigned long offsetLow,
+                                                               size_t size);
+extern "C" __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* address);
+extern "C" __declspec(dllimport) int __stdcall CloseHandle(void* handle);
+extern "C" __declspec(dllimport) unsigned long __stdcall GetCurrentProcessId();
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Namespace for everything related to publishing profiler data through shared memory.
+ */
+namespace profiler_shm
+{
+    constexpr char countersMagic[4] = {'M', 'P', 'V', 'C'}; /**< First bytes of every counters segment. */
+    constexpr uint16_t countersVersion = 1; /**< Version of the counters layout written by this header. */
+
+    /**
+     * Snapshot of the counters of a memory profiler.
+     * @remark Only 8 byte fields, it gets copied in and out of the segment as 64-bit words.
+     */
+    struct LiveCounters
+    {
+        uint64_t timestamp = 0; /**< steady_clock nanoseconds when the snapshot was taken. */
+        int64_t liveBytes = 0; /**< Bytes allocated and not yet deallocated. */
+        uint64_t peakBytes = 0; /**< Highest amount of live bytes seen. */
+        uint64_t allocations = 0; /**< How many allocations happened. */
+        uint64_t deallocations = 0; /**< How many deallocations happened. */
+        uint64_t bytesAllocated = 0; /**< Total bytes allocated. */
+        uint64_t bytesDeallocated = 0; /**< Total bytes deallocated. */
+        double allocationsPerSecond = 0; /**< Allocations per second since the previous snapshot. */
+        double deallocationsPerSecond = 0; /**< Deallocations per second since the previous snapshot. */
+    };
+
+    /**
+     * Amount of 64-bit words LiveCounters takes in the segment.
+     */
+    constexpr size_t counterWords = sizeof(LiveCounters) / sizeof(uint64_t);
+    static_assert(sizeof(LiveCounters) == counterWords * sizeof(uint64_t), "LiveCounters must only hold 8 byte fields");
+
+    /**
+     * Layout of a counters segment.
+     */
+    struct CounterSegment
+    {
+        char magic[4]; /**< countersMagic once the segment is initialized. */
+        uint16_t version; /**< countersVersion of the writer. */
+        uint16_t reserved; /**< Always 0. */
+        uint32_t processId; /**< Process publishing the counters. */
+        uint32_t publishInterval; /**< Milliseconds between publications. */
+        std::atomic<uint64_t> sequence; /**< Seqlock, odd while the counters are being written. */
+        std::array<std::atomic<uint64_t>, counterWords> counters; /**< LiveCounters copied word by word. */
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs address free atomics");
+
+    constexpr char eventsMagic[4] = {'M', 'P', 'V', 'R'}; /**< First bytes of every events segment. */
+    constexpr uint16_t eventsVersion = 1; /**< Version of the events layout written by this header. */
+
+    /**
+     * Kinds of events in the ring.
+     */
+    enum class EVENT : uint8_t
+    {
+        ALLOCATION = 1, /**< A block got allocated, size is the requested size. */
+        DEALLOCATION = 2 /**< A block got deallocated, size is 0. */
+    };
+
+    /**
+     * An allocation or deallocation published while profiling.
+     */
+    struct LiveEvent
+    {
+        uint64_t address; /**< Address of the block. */
+        uint64_t size; /**< Size of the allocation, 0 for deallocations. */
+        int64_t timestamp; /**< Time stamp in ticks, see EventRing::ticksPerSecond. */
+        uint32_t threadId; /**< Thread that allocated or deallocated the block. */
+        EVENT kind; /**< Whether the block was allocated or deallocated. */
+    };
+
+    /**
+     * A slot of the ring. The sequence tells producers and consumers whose turn it is.
+     */
+    struct EventSlot
+    {
+        std::atomic<uint64_t> sequence; /**< Equal to the position when free, position + 1 when it holds an event. */
+        LiveEvent event; /**< The event, only valid while the sequence says so. */
+    };
+
+    /**
+     * Header of an events segment. The slots follow it.
+     */
+    struct alignas(64) EventRing
+    {
+        char magic[4]; /**< eventsMagic once the segment is initialized. */
+        uint16_t version; /**< eventsVersion of the writer. */
+        uint16_t reserved; /**< Always 0. */
+        uint32_t processId; /**< Process publishing the events. */
+        uint32_t capacity; /**< Amount of slots, a power of two. */
+        uint64_t ticksPerSecond; /**< Ticks per second of the event timestamps. */
+        std::atomic<uint64_t> dropped; /**< Events thrown away because the ring was full. */
+        alignas(64) std::atomic<uint64_t> enqueuePosition; /**< Next slot to write. */
+        alignas(64) std::atomic<uint64_t> dequeuePosition; /**< Next slot to read. */
+    };
+
+    /**
+     * Get the id of the calling process.
+     * @return The process id
+     */
+    inline uint32_t ProcessId()
+    {
+#if defined(_WIN32)
+        return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    /**
+     * Fill the header of a new counters segment. The magic is cleared first and written last, readers ignore the
+     * segment in between so they never see a reused one half initialized.
+     * @param segment Segment to initialize
+     * @param publishInterval Milliseconds between publications
+     */
+    inline void InitializeCounters(CounterSegment& segment, const uint32_t publishInterval)
+    {
+        std::memset(segment.magic, 0, sizeof(segment.magic));
+        std::atomic_thread_fence(std::memory_order_release);
+        segment.version = countersVersion;
+        segment.reserved = 0;
+        segment.processId = ProcessId();
+        segment.publishInterval = publishInterval;
+        segment.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(segment.magic, countersMagic, sizeof(countersMagic));
+    }
+
+    /**
+     * Publish a snapshot. Only the single writer of the segment may call this.
+     * @param segment Segment to write into
+     * @param counters The snapshot
+     */
+    inline void PublishCounters(CounterSegment& segment, const LiveCounters& counters)
+    {
+        const auto words = std::bit_cast<std::array<uint64_t, counterWords>>(counters);
+
+        const uint64_t sequence = segment.sequence.load(std::memory_order_relaxed);
+        segment.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < counterWords; i++)
+        {
+            segment.counters[i].store(words[i], std::memory_order_relaxed);
+        }
+        segment.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * Read the latest snapshot, retrying while the writer is in the middle of publishing one.
+     * @param segment Segment to read from
+     * @param counters Output parameter for the snapshot
+     * @return Whether the segment holds counters of a layout this header understands
+     */
+    inline bool ReadCounters(const CounterSegment& segment, LiveCounters& counters)
+    {
+        if (std::memcmp(segment.magic, countersMagic, sizeof(countersMagic)) != 0 || segment.version != countersVersion)
+        {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        std::array<uint64_t, counterWords> words;
+        while (true)
+        {
+            const uint64_t before = segment.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (size_t i = 0; i < counterWords; i++)
+            {
+                words[i] = segment.counters[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (segment.sequence.load(std::memory_order_relaxed) == before)
+            {
+                break;
+            }
+        }
+
+        counters = std::bit_cast<LiveCounters>(words);
+        return true;
+    }
+
+    /**
+     * Get the slots of a ring.
+     * @param ring Header of the ring
+     * @return The first slot, right after the header
+     */
+    inline EventSlot* Slots(EventRing& ring)
+    {
+        return reinterpret_cast<EventSlot*>(&ring + 1);
+    }
+
+    /**
+     * Get the size of an events segment.
+     * @param capacity Amount of slots
+     * @return Size of the segment in bytes
+     */
+    constexpr size_t EventRingSize(const uint32_t capacity)
+    {
+        return sizeof(EventRing) + capacity * sizeof(EventSlot);
+    }
+
+    /**
+     * Fill the header and slots of a new events segment. The magic is cleared first and written last, readers ignore
+     * the segment in between so they never see a reused one half initialized.
+     * @param ring Segment to initialize, big enough for the capacity
+     * @param capacity Amount of slots, a power of two
+     * @param ticksPerSecond Ticks per second of the event timestamps
+     */
+    inline void InitializeEvents(EventRing& ring, const uint32_t capacity, const uint64_t ticksPerSecond)
+    {
+        std::memset(ring.magic, 0, sizeof(ring.magic));
+        std::atomic_thread_fence(std::memory_order_release);
+        ring.version = eventsVersion;
+        ring.reserved = 0;
+        ring.processId = ProcessId();
+        ring.capacity = capacity;
+        ring.ticksPerSecond = ticksPerSecond;
+        ring.dropped.store(0, std::memory_order_relaxed);
+        ring.enqueuePosition.store(0, std::memory_order_relaxed);
+        ring.dequeuePosition.store(0, std::memory_order_relaxed);
+        EventSlot* slots = Slots(ring);
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(ring.magic, eventsMagic, sizeof(eventsMagic));
+    }
+
+    /**
+     * Append an event without ever waiting. Any thread may call this.
+     * @param ring The ring
+     * @param event The event
+     * @return Whether there was space, the event is counted as dropped otherwise
+     */
+    inline bool PushEvent(EventRing& ring, const LiveEvent& event)
+    {
+        EventSlot* slots = Slots(ring);
+        const uint64_t mask = ring.capacity - 1;
+        uint64_t position = ring.enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            EventSlot& slot = slots[position & mask];
+            const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const int64_t difference = static_cast<int64_t>(sequence - position);
+            if (difference == 0)
+            {
+                if (ring.enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.event = event;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                // A whole lap ahead of the readers
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                position = ring.enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest event without ever waiting. Any thread may call this.
+     * @param ring The ring
+     * @param event Output parameter for the event
+     * @return Whether there was an event to take
+     */
+    inline bool PopEvent(EventRing& ring, LiveEvent& event)
+    {
+        EventSlot* slots = Slots(ring);
+        const uint64_t mask = ring.capacity - 1;
+        uint64_t position = ring.dequeuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            EventSlot& slot = slots[position & mask];
+            const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const int64_t difference = static_cast<int64_t>(sequence - (position + 1));
+            if (difference == 0)
+            {
+                if (ring.dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    event = slot.event;
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Empty, or a producer is still writing the oldest slot
+            }
+            else
+            {
+                position = ring.dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * A named shared memory segment mapped into this process. The process that creates it removes the name when it
+     * gets destroyed, processes that only opened it just unmap it.
+     */
+    class SharedMemory // NOLINT(cppcoreguidelines-special-member-functions)
+    {
+    public:
+        SharedMemory() = default;
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+
+        /**
+         * Unmap the segment, removing its name if this process created it.
+         */
+        ~SharedMemory()
+        {
+            Close();
+        }
+
+        /**
+         * Create a segment. On POSIX systems a segment left behind under the same name, by a process that crashed
+         * for example, is removed first. Windows removes mappings with their last handle, one that still exists is
+         * reused and gets its magic cleared while it's initialized again.
+         * @param name Name of the segment, without any platform prefix
+         * @param size Size of the segment in bytes
+         * @return Whether the segment could be created and mapped
+         */
+        bool Create(const std::string& name, const size_t size)
+        {
+            Close();
+#if defined(_WIN32)
+            // INVALID_HANDLE_VALUE backs the mapping with the paging file. 0x04 is PAGE_READWRITE.
+            m_handle_ = CreateFileMappingA(reinterpret_cast<void*>(-1), nullptr, 0x04,
+                                           static_cast<unsigned long>(static_cast<uint64_t>(size) >> 32),
+                                           static_cast<unsigned long>(size), PlatformName(name).c_str());
+#else
+            // A stale segment could have another size and would still hold the old contents.
+            shm_unlink(PlatformName(name).c_str());
+            m_descriptor_ = shm_open(PlatformName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (m_descriptor_ >= 0 && ftruncate(m_descriptor_, static_cast<off_t>(size)) != 0)
+            {
+                ReleaseHandle();
+                shm_unlink(PlatformName(name).c_str());
+                return false;
+            }
+#endif
+            m_name_ = name;
+            m_owner_ = true;
+            return Map(size);
+        }
+
+        /**
+         * Open a segment created by another process.
+         * @param name Name of the segment, without any platform prefix
+         * @param size Amount of bytes to map
+         * @return Whether the segment exists and could be mapped
+         */
+        bool Open(const std::string& name, const size_t size)
+        {
+            Close();
+#if defined(_WIN32)
+            // 0xF001F is FILE_MAP_ALL_ACCESS.
+            m_handle_ = OpenFileMappingA(0xF001F, 0, PlatformName(name).c_str());
+#else
+            m_descriptor_ = shm_open(PlatformName(name).c_str(), O_RDWR, 0600);
+#endif
+            m_name_ = name;
+            m_owner_ = false;
+            return Map(size);
+        }
+
+        /**
+         * Unmap the segment, removing its name if this process created it. Does nothing if nothing is mapped.
+         */
+        void Close()
+        {
+            if (m_data_ != nullptr)
+            {
+#if defined(_WIN32)
+                UnmapViewOfFile(m_data_);
+#else
+                munmap(m_data_, m_size_);
+#endif
+            }
+            ReleaseHandle();
+            if (m_owner_)
+            {
+#if !defined(_WIN32)
+                shm_unlink(PlatformName(m_name_).c_str());
+#endif
+            }
+            m_data_ = nullptr;
+            m_size_ = 0;
+            m_owner_ = false;
+        }
+
+        /**
+         * Get the mapped memory.
+         * @return Start of the segment, nullptr if nothing is mapped
+         */
+        [[nodiscard]] void* Data() const
+        {
+            return m_data_;
+        }
+
+        /**
+         * Get the mapped size.
+         * @return Amount of bytes mapped
+         */
+        [[nodiscard]] size_t Size() const
+        {
+            return m_size_;
+        }
+
+    private:
+        /**
+         * Turn a segment name into what the OS expects.
+         * @param name Name of the segment
+         * @return "/name" on POSIX systems, "Local\name" on Windows
+         */
+        static std::string PlatformName(const std::string& name)
+        {
+#if defined(_WIN32)
+            return "Local\\" + name;
+#else
+            return "/" + name;
+#endif
+        }
+
+        /**
+         * Map the opened segment. POSIX descriptors aren't needed afterward and get closed.
+         * @param size Amount of bytes to map
+         * @return Whether the mapping succeeded
+         */
+        bool Map(const size_t size)
+        {
+#if defined(_WIN32)
+            if (m_handle_ == nullptr)
+            {
+                m_owner_ = false;
+                return false;
+            }
+            // The handle stays open, the mapping disappears with the last handle if nobody else opened it.
+            m_data_ = MapViewOfFile(m_handle_, 0xF001F, 0, 0, size);
+#else
+            if (m_descriptor_ < 0)
+            {
+                m_owner_ = false;
+                return false;
+            }
+            void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_descriptor_, 0);
+            m_data_ = mapping == MAP_FAILED ? nullptr : mapping;
+            ReleaseHandle();
+#endif
+            if (m_data_ == nullptr)
+            {
+                Close();
+                return false;
+            }
+            m_size_ = size;
+            return true;
+        }
+
+        /**
+         * Close the handle of the segment if it's still open.
+         */
+        void ReleaseHandle()
+        {
+#if defined(_WIN32)
+            if (m_handle_ != nullptr)
+            {
+                CloseHandle(m_handle_);
+                m_handle_ = nullptr;
+            }
+#else
+            if (m_descriptor_ >= 0)
+            {
+                close(m_descriptor_);
+                m_descriptor_ = -1;
+            }
+#endif
+        }
+
+        std::string m_name_; /**< Name of the segment, without the platform prefix. */
+#if defined(_WIN32)
+        void* m_handle_ = nullptr; /**< Handle of the file mapping. */
+#else
+        int m_descriptor_ = -1; /**< Descriptor of the segment, only open until it gets mapped. */
+#endif
+        void* m_data_ = nullptr; /**< Start of the mapping. */
+        size_t m_size_ = 0; /**< Size of the mapping. */
+        bool m_owner_ = false; /**< Whether this process created the segment and has to remove its name. */
+    };
+
+    /**
+     * Open an events segment created by another process, mapping all its slots.
+     * @param memory Shared memory object to open the segment with
+     * @param name Name of the segment, without any platform prefix
+     * @return The ring, nullptr if the segment doesn't exist yet or holds a layout this header doesn't understand
+     */
+    inline EventRing* OpenEvents(SharedMemory& memory, const std::string& name)
+    {
+        // The header tells how big the segment is.
+        if (!memory.Open(name, sizeof(EventRing)))
+        {
+            return nullptr;
+        }
+        const auto* header = static_cast<const EventRing*>(memory.Data());
+        if (std::memcmp(header->magic, eventsMagic, sizeof(eventsMagic)) != 0 || header->version != eventsVersion)
+        {
+            memory.Close();
+            return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        const uint32_t capacity = header->capacity;
+        if (!memory.Open(name, EventRingSize(capacity)))
+        {
+            return nullptr;
+        }
+        return static_cast<EventRing*>(memory.Data());
+    }
+}
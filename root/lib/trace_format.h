@@ -0,0 +1,800 @@
+//
+// Binary trace format used by the Instrumentor when the session is started with TraceFormat::BINARY.
+// Regardless of the copyright notice on modified versions of the code in the code this file should be considered under the MIT license.
+//
+// Layout (version 1):
+//
+// [Header]  fixed size, little endian
+//     char     magic[4]     "MPVT"
+//     uint16_t version
+//     uint16_t flags        reserved, always 0
+// [Records] until RECORD::END
+//     uint8_t  tag          one of RECORD
+//     ...      payload      LEB128 varints, signed values are zig-zag encoded
+//
+// Strings, call sites, frames and stacks are only written once, the first time they are used, and later records refer to them by ID.
+// Frames are written as raw addresses while profiling and their SYMBOL records are all written together before END, so
+// every unique address is only symbolized once per session.
+// Timestamps are stored as the difference with the previous timestamp in the file because consecutive events are close
+// in time, so most of them fit in one or two bytes. They are raw ticks of the clock named in the SESSION record, which
+// also stores how many ticks make a second.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Output formats supported by the Instrumentor.
+ */
+enum class TraceFormat : uint8_t
+{
+    JSON, /**< Chrome tracing compatible JSON. Human-readable but verbose. */
+    BINARY /**< Compact binary format described in trace_format.h */
+};
+
+/**
+ * Namespace for everything related to encoding and decoding the binary trace format.
+ */
+namespace trace_format
+{
+    constexpr char magic[4] = {'M', 'P', 'V', 'T'}; /**< First bytes of every binary trace. */
+    constexpr uint16_t version = 1; /**< Version of the layout written by this header. */
+
+    /**
+     * Tags at the start of every record.
+     */
+    enum class RECORD : uint8_t
+    {
+        SESSION = 1, /**< string id of the session name, clock source, clock ticks per second */
+        STRING = 2, /**< id, length, bytes. Strings are written JSON escaped. */
+        STACK = 3, /**< id, frame count, frame id per frame */
+        TIMER = 4, /**< call site id, thread id, start delta, duration */
+        MEMORY = 5,
+        /**< flags, thread id, address, size, start delta, duration if deallocated, stack id, estimated size if sampled,
+         * call site id of the timer scope + 1 or 0 outside of any */
+        FRAME = 6, /**< id, raw address */
+        SYMBOL = 7, /**< frame id, string id of the resolved symbol */
+        MEMORY_SUMMARY = 8,
+        /**< name string id, allocations, deallocations, bytes allocated, bytes deallocated, peak bytes, 64 allocation
+         * histogram buckets, 64 deallocation histogram buckets, scope count, then call site id, allocations and bytes
+         * allocated per timer scope */
+        ALLOCATION = 9,
+        /**< thread id, address, size, timestamp delta, stack id, call site id of the timer scope + 1 or 0 outside of any.
+         * Written by streaming profilers. */
+        DEALLOCATION = 10, /**< thread id, address, timestamp delta. Written by streaming profilers. */
+        DROPPED = 11, /**< amount of entries dropped by BackpressurePolicy::DROP. Only written before END if not 0. */
+        CALLSITE = 12, /**< id, name string id, file string id, line. The name and file are already JSON escaped. */
+        PEAK = 13, /**< name string id of the memory profiler, timestamp delta, live bytes. A new high-water mark. */
+        PEAK_SNAPSHOT = 14,
+        /**< name string id of the memory profiler, timestamp delta, live bytes, site count, then stack id, live bytes
+         * and live allocations per call site. What was live at the highest peak, written when the profiler stops. */
+        CALL_TREE = 15,
+        /**< parent node id, call site id, calls, total ticks, self ticks, min ticks, max ticks. One node of the merged
+         * call tree of TimerMode::CALL_TREE sessions, numbered from 1 in the order they are written, 0 is the root.
+         * Parents are always written before their children. */
+        COUNTERS = 16,
+        /**< name string id of the memory profiler, timestamp delta, live bytes, live allocations. A sample written by
+         * InstrumentationMemory::SampleCounters. */
+        FRAME_MARK = 17,
+        /**< frame number, start timestamp delta, duration, allocations, bytes allocated. One frame between two calls to
+         * Instrumentor::MarkFrame. */
+        END = 0xFF /**< Last record of the file. */
+    };
+
+    /**
+     * Flags stored in the MEMORY record.
+     */
+    enum MEMORY_FLAGS : uint8_t
+    {
+        NONE = 0,
+        IS_ARRAY = 1 << 0,
+        DEALLOCATED = 1 << 1,
+        SAMPLED = 1 << 2,
+    };
+
+    /**
+     * Write an unsigned integer as a LEB128 varint.
+     * @param stream Stream to write into
+     * @param value Value to write
+     */
+    inline void WriteVarint(std::ostream& stream, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            stream.put(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        stream.put(static_cast<char>(value));
+    }
+
+    /**
+     * Write a signed integer as a zig-zag encoded varint so that small negative numbers stay small.
+     * @param stream Stream to write into
+     * @param value Value to write
+     */
+    inline void WriteSignedVarint(std::ostream& stream, const int64_t value)
+    {
+        WriteVarint(stream, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    /**
+     * Write an unsigned 16-bit value in little endian regardless of the host.
+     * @param stream Stream to write into
+     * @param value Value to write
+     */
+    inline void WriteU16(std::ostream& stream, const uint16_t value)
+    {
+        stream.put(static_cast<char>(value & 0xFF));
+        stream.put(static_cast<char>(value >> 8));
+    }
+
+    /**
+     * Escape a string so it can be written between quotes in a JSON file.
+     * @param value The string to escape
+     * @return The escaped string
+     */
+    inline std::string EscapeJson(const std::string_view value)
+    {
+        std::string result;
+        result.reserve(value.size());
+        for (const char character : value)
+        {
+            switch (character)
+            {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(character) >= 0x20)
+                    result += character;
+                break;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Turn clock ticks into nanoseconds. Split in whole seconds and remainder so it doesn't overflow.
+     * @param ticks Ticks to convert
+     * @param ticksPerSecond Calibration of the clock
+     * @return The equivalent amount of nanoseconds
+     */
+    inline long long TicksToNanoseconds(const long long ticks, const uint64_t ticksPerSecond)
+    {
+        const long long rate = static_cast<long long>(ticksPerSecond);
+        return ticks / rate * 1'000'000'000 + ticks % rate * 1'000'000'000 / rate;
+    }
+
+    /**
+     * Write clock ticks as microseconds with nanosecond decimals, the unit chrome://tracing expects.
+     * @param stream Stream to write into
+     * @param ticks Ticks to write
+     * @param ticksPerSecond Calibration of the clock
+     */
+    inline void WriteMicroseconds(std::ostream& stream, const long long ticks, const uint64_t ticksPerSecond)
+    {
+        long long nanoseconds = TicksToNanoseconds(ticks, ticksPerSecond);
+        if (nanoseconds < 0)
+        {
+            stream.put('-');
+            nanoseconds = -nanoseconds;
+        }
+
+        const long long fraction = nanoseconds % 1000;
+        stream << nanoseconds / 1000 << '.';
+        stream.put(static_cast<char>('0' + fraction / 100));
+        stream.put(static_cast<char>('0' + fraction / 10 % 10));
+        stream.put(static_cast<char>('0' + fraction % 10));
+    }
+
+    /**
+     * Write the fixed size header of the file.
+     * @param stream Stream to write into
+     */
+    inline void WriteHeader(std::ostream& stream)
+    {
+        stream.write(magic, sizeof(magic));
+        WriteU16(stream, version);
+        WriteU16(stream, 0);
+    }
+
+    /**
+     * Read a LEB128 varint.
+     * @param stream Stream to read from
+     * @return The decoded value
+     * @throws error Errors if the stream ends in the middle of the value
+     */
+    inline uint64_t ReadVarint(std::istream& stream)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const int byte = stream.get();
+            if (byte == std::istream::traits_type::eof())
+            {
+                throw "Unexpected end of binary trace";
+            }
+
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        return value;
+    }
+
+    /**
+     * Read a zig-zag encoded varint.
+     * @param stream Stream to read from
+     * @return The decoded value
+     */
+    inline int64_t ReadSignedVarint(std::istream& stream)
+    {
+        const uint64_t value = ReadVarint(stream);
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    /**
+     * Check whether a stream holds a binary trace. The stream position is restored afterward.
+     * @param stream Stream to check
+     * @return Whether the stream starts with the binary trace magic
+     */
+    inline bool IsBinaryTrace(std::istream& stream)
+    {
+        char read[sizeof(magic)] = {};
+        const auto position = stream.tellg();
+        stream.read(read, sizeof(read));
+        const bool result = stream.gcount() == sizeof(read) && std::equal(std::begin(read), std::end(read), magic);
+        stream.clear();
+        stream.seekg(position);
+        return result;
+    }
+
+    /**
+     * Call site read from a CALLSITE record.
+     */
+    struct CallSite
+    {
+        uint64_t name; /**< string id of the escaped name */
+        uint64_t file; /**< string id of the escaped file */
+        uint64_t line; /**< line in the file */
+    };
+
+    /**
+     * Lookup tables of a binary trace, filled while reading the records.
+     */
+    struct TraceTables
+    {
+        std::unordered_map<uint64_t, std::string> strings; /**< string id to string */
+        std::unordered_map<uint64_t, uint64_t> frames; /**< frame id to raw address */
+        std::unordered_map<uint64_t, uint64_t> symbols; /**< frame id to string id of its symbol */
+        std::unordered_map<uint64_t, std::vector<uint64_t>> stacks; /**< stack id to frame ids */
+        std::vector<std::string> memorySummaries; /**< memory summaries, already formatted as JSON objects */
+        std::vector<std::string> peakSnapshots; /**< peak snapshots, already formatted as JSON objects */
+        std::vector<std::string> callTree; /**< call tree nodes, already formatted as JSON objects */
+        uint64_t droppedEntries = 0; /**< entries the profiler dropped instead of writing */
+        std::map<uint64_t, CallSite> callSites; /**< call site id to its strings and line */
+        uint64_t clockSource = 0; /**< clock the timestamps were taken with, 0 steady_clock and 1 the CPU counter */
+        uint64_t ticksPerSecond = 1'000'000'000; /**< calibration of the clock */
+    };
+
+    /**
+     * Amount of buckets in each histogram of a MEMORY_SUMMARY record.
+     */
+    constexpr size_t histogramBuckets = 64;
+
+    /**
+     * Read every record after the header.
+     * @param in Stream positioned right after the header
+     * @param tables Tables to fill with the records that define strings, frames and stacks
+     * @param out Stream to write the events into as JSON. nullptr to only fill the tables.
+     * @throws error Errors if an unknown record is found
+     */
+    inline void ReadRecords(std::istream& in, TraceTables& tables, std::ostream* out)
+    {
+        long long lastTimestamp = 0;
+        bool firstEntry = true;
+
+        for (int tag = in.get(); tag != std::istream::traits_type::eof() && tag != static_cast<int>(RECORD::END); tag = in.get())
+        {
+            switch (static_cast<RECORD>(tag))
+            {
+            case RECORD::SESSION:
+                ReadVarint(in);
+                tables.clockSource = ReadVarint(in);
+                tables.ticksPerSecond = ReadVarint(in);
+                break;
+            case RECORD::STRING:
+                {
+                    const uint64_t id = ReadVarint(in);
+                    std::string value(ReadVarint(in), '\0');
+                    in.read(value.data(), static_cast<std::streamsize>(value.size()));
+                    tables.strings[id] = std::move(value);
+                    break;
+                }
+            case RECORD::FRAME:
+                {
+                    const uint64_t id = ReadVarint(in);
+                    tables.frames[id] = ReadVarint(in);
+                    break;
+                }
+            case RECORD::SYMBOL:
+                {
+                    const uint64_t id = ReadVarint(in);
+                    tables.symbols[id] = ReadVarint(in);
+                    break;
+                }
+            case RECORD::ALLOCATION:
+                {
+                    const uint64_t threadId = ReadVarint(in);
+                    const uint64_t address = ReadVarint(in);
+                    const uint64_t size = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t stackId = ReadVarint(in);
+                    const uint64_t scope = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"alloc\",";
+                    *out << "\"name\":\"" << reinterpret_cast<void*>(address) << "\",";
+                    *out << "\"tid\":" << threadId << ",";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"size\":" << size << ",";
+                    if (scope != 0)
+                        *out << "\"sid\":" << scope - 1 << ",";
+                    *out << "\"stackId\":" << stackId;
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::DEALLOCATION:
+                {
+                    const uint64_t threadId = ReadVarint(in);
+                    const uint64_t address = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"free\",";
+                    *out << "\"name\":\"" << reinterpret_cast<void*>(address) << "\",";
+                    *out << "\"tid\":" << threadId << ",";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::MEMORY_SUMMARY:
+                {
+                    const uint64_t nameId = ReadVarint(in);
+                    const uint64_t allocations = ReadVarint(in);
+                    const uint64_t deallocations = ReadVarint(in);
+                    const uint64_t bytesAllocated = ReadVarint(in);
+                    const uint64_t bytesDeallocated = ReadVarint(in);
+                    const uint64_t peakBytes = ReadVarint(in);
+
+                    std::ostringstream summary;
+                    summary << "{";
+                    summary << "\"name\":\"" << tables.strings[nameId] << "\",";
+                    summary << "\"allocations\":" << allocations << ",";
+                    summary << "\"deallocations\":" << deallocations << ",";
+                    summary << "\"bytesAllocated\":" << bytesAllocated << ",";
+                    summary << "\"bytesDeallocated\":" << bytesDeallocated << ",";
+                    summary << "\"liveBytes\":" << static_cast<long long>(bytesAllocated - bytesDeallocated) << ",";
+                    summary << "\"peakBytes\":" << peakBytes;
+                    for (const char* histogramName : {"allocationHistogram", "deallocationHistogram"})
+                    {
+                        std::vector<uint64_t> histogram(histogramBuckets);
+                        for (auto& bucket : histogram)
+                        {
+                            bucket = ReadVarint(in);
+                        }
+                        while (!histogram.empty() && histogram.back() == 0)
+                        {
+                            histogram.pop_back();
+                        }
+
+                        summary << ",\"" << histogramName << "\":[";
+                        for (size_t i = 0; i < histogram.size(); i++)
+                        {
+                            summary << (i > 0 ? "," : "") << histogram[i];
+                        }
+                        summary << "]";
+                    }
+
+                    summary << ",\"scopes\":[";
+                    const uint64_t scopeCount = ReadVarint(in);
+                    for (uint64_t i = 0; i < scopeCount; i++)
+                    {
+                        const uint64_t callSiteId = ReadVarint(in);
+                        const uint64_t scopeAllocations = ReadVarint(in);
+                        const uint64_t scopeBytes = ReadVarint(in);
+                        summary << (i > 0 ? ",{" : "{");
+                        summary << "\"sid\":" << callSiteId << ",";
+                        summary << "\"allocations\":" << scopeAllocations << ",";
+                        summary << "\"bytesAllocated\":" << scopeBytes;
+                        summary << "}";
+                    }
+                    summary << "]}";
+
+                    if (out == nullptr)
+                        tables.memorySummaries.push_back(summary.str());
+                    break;
+                }
+            case RECORD::PEAK:
+                {
+                    const uint64_t nameId = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t liveBytes = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"peak\",";
+                    *out << "\"name\":\"" << tables.strings[nameId] << "\",";
+                    *out << "\"ph\":\"C\",";
+                    *out << "\"pid\":0,";
+                    *out << "\"tid\":0,";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"args\":{\"liveBytes\":" << liveBytes << "}";
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::FRAME_MARK:
+                {
+                    const uint64_t number = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t duration = ReadVarint(in);
+                    const uint64_t allocations = ReadVarint(in);
+                    const uint64_t bytesAllocated = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"frame\",";
+                    *out << "\"dur\":";
+                    WriteMicroseconds(*out, static_cast<long long>(duration), tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"name\":\"Frame " << number << "\",";
+                    *out << "\"ph\":\"X\",";
+                    *out << "\"pid\":0,";
+                    *out << "\"tid\":0,";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"args\":{\"frame\":" << number << ",";
+                    *out << "\"allocations\":" << allocations << ",";
+                    *out << "\"bytesAllocated\":" << bytesAllocated << "}";
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::COUNTERS:
+                {
+                    const uint64_t nameId = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t liveBytes = ReadVarint(in);
+                    const uint64_t liveAllocations = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"counters\",";
+                    *out << "\"name\":\"" << tables.strings[nameId] << "\",";
+                    *out << "\"ph\":\"C\",";
+                    *out << "\"pid\":0,";
+                    *out << "\"tid\":0,";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"args\":{\"liveBytes\":" << liveBytes << "}";
+                    *out << "},{";
+                    *out << "\"cat\":\"counters\",";
+                    *out << "\"name\":\"" << tables.strings[nameId] << " allocations\",";
+                    *out << "\"ph\":\"C\",";
+                    *out << "\"pid\":0,";
+                    *out << "\"tid\":0,";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"args\":{\"liveAllocations\":" << liveAllocations << "}";
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::PEAK_SNAPSHOT:
+                {
+                    const uint64_t nameId = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t liveBytes = ReadVarint(in);
+
+                    std::ostringstream snapshot;
+                    snapshot << "{";
+                    snapshot << "\"name\":\"" << tables.strings[nameId] << "\",";
+                    snapshot << "\"ts\":";
+                    WriteMicroseconds(snapshot, lastTimestamp, tables.ticksPerSecond);
+                    snapshot << ",";
+                    snapshot << "\"liveBytes\":" << liveBytes << ",";
+                    snapshot << "\"sites\":[";
+                    const uint64_t siteCount = ReadVarint(in);
+                    for (uint64_t i = 0; i < siteCount; i++)
+                    {
+                        const uint64_t stackId = ReadVarint(in);
+                        const uint64_t bytes = ReadVarint(in);
+                        const uint64_t count = ReadVarint(in);
+                        snapshot << (i > 0 ? ",{" : "{");
+                        snapshot << "\"stackId\":" << stackId << ",";
+                        snapshot << "\"bytes\":" << bytes << ",";
+                        snapshot << "\"count\":" << count;
+                        snapshot << "}";
+                    }
+                    snapshot << "]}";
+
+                    if (out == nullptr)
+                        tables.peakSnapshots.push_back(snapshot.str());
+                    break;
+                }
+            case RECORD::CALL_TREE:
+                {
+                    const uint64_t parent = ReadVarint(in);
+                    const uint64_t callSiteId = ReadVarint(in);
+                    const uint64_t calls = ReadVarint(in);
+                    const uint64_t total = ReadVarint(in);
+                    const uint64_t self = ReadVarint(in);
+                    const uint64_t min = ReadVarint(in);
+                    const uint64_t max = ReadVarint(in);
+                    if (out != nullptr)
+                        break;
+
+                    std::ostringstream node;
+                    node << "{";
+                    node << "\"id\":" << tables.callTree.size() + 1 << ",";
+                    node << "\"parent\":" << parent << ",";
+                    node << "\"sid\":" << callSiteId << ",";
+                    node << "\"name\":\"" << tables.strings[tables.callSites[callSiteId].name] << "\",";
+                    node << "\"calls\":" << calls << ",";
+                    node << "\"total\":";
+                    WriteMicroseconds(node, static_cast<long long>(total), tables.ticksPerSecond);
+                    node << ",\"self\":";
+                    WriteMicroseconds(node, static_cast<long long>(self), tables.ticksPerSecond);
+                    node << ",\"min\":";
+                    WriteMicroseconds(node, static_cast<long long>(min), tables.ticksPerSecond);
+                    node << ",\"max\":";
+                    WriteMicroseconds(node, static_cast<long long>(max), tables.ticksPerSecond);
+                    node << "}";
+                    tables.callTree.push_back(node.str());
+                    break;
+                }
+            case RECORD::STACK:
+                {
+                    const uint64_t id = ReadVarint(in);
+                    std::vector<uint64_t> frames(ReadVarint(in));
+                    for (auto& frame : frames)
+                    {
+                        frame = ReadVarint(in);
+                    }
+                    tables.stacks[id] = std::move(frames);
+                    break;
+                }
+            case RECORD::TIMER:
+                {
+                    const uint64_t callSiteId = ReadVarint(in);
+                    const uint64_t threadId = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const uint64_t duration = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"function\",";
+                    *out << "\"dur\":";
+                    WriteMicroseconds(*out, static_cast<long long>(duration), tables.ticksPerSecond);
+                    *out << ',';
+                    *out << "\"name\":\"" << tables.strings[tables.callSites[callSiteId].name] << "\",";
+                    *out << "\"sid\":" << callSiteId << ",";
+                    *out << "\"ph\":\"X\",";
+                    *out << "\"pid\":0,";
+                    *out << "\"tid\":" << threadId << ",";
+                    *out << "\"ts\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::MEMORY:
+                {
+                    const uint8_t flags = static_cast<uint8_t>(in.get());
+                    const uint64_t threadId = ReadVarint(in);
+                    const uint64_t address = ReadVarint(in);
+                    const uint64_t size = ReadVarint(in);
+                    lastTimestamp += ReadSignedVarint(in);
+                    const bool deallocated = flags & DEALLOCATED;
+                    const long long duration = deallocated ? static_cast<long long>(ReadVarint(in)) : -1;
+                    const uint64_t stackId = ReadVarint(in);
+                    const uint64_t estimatedSize = (flags & SAMPLED) ? ReadVarint(in) : size;
+                    const uint64_t scope = ReadVarint(in);
+                    if (out == nullptr)
+                        break;
+
+                    *out << (firstEntry ? "" : ",") << "{";
+                    *out << "\"cat\":\"" << (deallocated ? "Deallocated mem" : "Memory leaked") << "\",";
+                    *out << "\"dur(us)\":";
+                    if (deallocated)
+                        WriteMicroseconds(*out, duration, tables.ticksPerSecond);
+                    else
+                        *out << -1;
+                    *out << ',';
+                    *out << "\"name\":\"" << reinterpret_cast<void*>(address) << "\",";
+                    *out << "\"tid\":" << threadId << ",";
+                    *out << "\"tStart\":";
+                    WriteMicroseconds(*out, lastTimestamp, tables.ticksPerSecond);
+                    *out << ",";
+                    *out << "\"tEnd\":";
+                    if (deallocated)
+                        WriteMicroseconds(*out, lastTimestamp + duration, tables.ticksPerSecond);
+                    else
+                        *out << -1;
+                    *out << ",";
+                    *out << "\"size\":" << size << ",";
+                    if (flags & SAMPLED)
+                    {
+                        *out << "\"sampleWeight\":" << static_cast<double>(estimatedSize) / static_cast<double>(size) << ",";
+                        *out << "\"estimatedSize\":" << estimatedSize << ",";
+                    }
+                    if (scope != 0)
+                        *out << "\"sid\":" << scope - 1 << ",";
+                    *out << "\"stackId\":" << stackId;
+                    *out << "}";
+                    firstEntry = false;
+                    break;
+                }
+            case RECORD::CALLSITE:
+                {
+                    const uint64_t id = ReadVarint(in);
+                    CallSite& callSite = tables.callSites[id];
+                    callSite.name = ReadVarint(in);
+                    callSite.file = ReadVarint(in);
+                    callSite.line = ReadVarint(in);
+                    break;
+                }
+            case RECORD::DROPPED:
+                tables.droppedEntries = ReadVarint(in);
+                break;
+            case RECORD::END:
+            default:
+                throw "Unknown record in binary trace";
+            }
+        }
+    }
+
+    /**
+     * Write the stack and frame tables that JSON memory entries refer to by stackId.
+     * @param tables Tables read from the binary trace
+     * @param out Stream to write the JSON into
+     */
+    inline void WriteJsonStackTables(TraceTables& tables, std::ostream& out)
+    {
+        out << "\"stacks\":[";
+        for (size_t i = 0; i < tables.stacks.size(); i++)
+        {
+            const std::vector<uint64_t>& frames = tables.stacks[i];
+            out << (i > 0 ? ",[" : "[");
+            for (size_t j = 0; j < frames.size(); j++)
+            {
+                out << (j > 0 ? "," : "") << frames[j];
+            }
+            out << "]";
+        }
+        out << "],";
+
+        out << "\"frames\":[";
+        for (size_t i = 0; i < tables.frames.size(); i++)
+        {
+            out << (i > 0 ? ",\"" : "\"");
+            if (const auto symbol = tables.symbols.find(i); symbol != tables.symbols.end())
+                out << tables.strings[symbol->second];
+            else // Not symbolized, fall back to the raw address
+                out << reinterpret_cast<void*>(tables.frames[i]);
+            out << "\"";
+        }
+        out << "]";
+    }
+
+    /**
+     * Write the call site table that JSON timer and memory entries refer to by sid.
+     * @param tables Tables read from the binary trace
+     * @param out Stream to write the JSON into
+     */
+    inline void WriteJsonCallSites(TraceTables& tables, std::ostream& out)
+    {
+        out << "\"callSites\":[";
+        bool first = true;
+        for (const auto& [id, callSite] : tables.callSites)
+        {
+            out << (first ? "{" : ",{");
+            out << "\"id\":" << id << ",";
+            out << "\"name\":\"" << tables.strings[callSite.name] << "\",";
+            out << "\"file\":\"" << tables.strings[callSite.file] << "\",";
+            out << "\"line\":" << callSite.line;
+            out << "}";
+            first = false;
+        }
+        out << "]";
+    }
+
+    /**
+     * Convert a binary trace into the JSON layout written by TraceFormat::JSON sessions so existing tools can read it.
+     * @remark Symbols are written at the end of the trace so the input is read twice, it must be seekable.
+     * @param in Stream holding the binary trace, opened in binary mode
+     * @param out Stream to write the JSON into
+     * @throws error Errors if the input is not a binary trace or uses an unknown version
+     */
+    inline void ConvertToJson(std::istream& in, std::ostream& out)
+    {
+        char readMagic[sizeof(magic)] = {};
+        in.read(readMagic, sizeof(readMagic));
+        if (in.gcount() != sizeof(readMagic) || !std::equal(std::begin(readMagic), std::end(readMagic), magic))
+        {
+            throw "The file is not a binary trace";
+        }
+
+        const uint16_t readVersion = static_cast<uint16_t>(in.get() | (in.get() << 8));
+        in.get(); // flags
+        in.get();
+        if (readVersion != version)
+        {
+            throw "Unsupported binary trace version";
+        }
+
+        const auto recordsStart = in.tellg();
+        TraceTables tables;
+        ReadRecords(in, tables, nullptr);
+
+        in.clear();
+        in.seekg(recordsStart);
+        out << "{\"otherData\": {\"clock\":\"" << (tables.clockSource == 1 ? "tsc" : "steady") << "\",";
+        out << "\"ticksPerSecond\":" << tables.ticksPerSecond << "},\"traceEvents\":[";
+        ReadRecords(in, tables, &out);
+        out << "],";
+        WriteJsonStackTables(tables, out);
+        out << ",\"memorySummaries\":[";
+        for (size_t i = 0; i < tables.memorySummaries.size(); i++)
+        {
+            out << (i > 0 ? "," : "") << tables.memorySummaries[i];
+        }
+        out << "],\"peakSnapshots\":[";
+        for (size_t i = 0; i < tables.peakSnapshots.size(); i++)
+        {
+            out << (i > 0 ? "," : "") << tables.peakSnapshots[i];
+        }
+        out << "],\"callTree\":[";
+        for (size_t i = 0; i < tables.callTree.size(); i++)
+        {
+            out << (i > 0 ? "," : "") << tables.callTree[i];
+        }
+        out << "],";
+        WriteJsonCallSites(tables, out);
+        out << ",\"droppedEntries\":" << tables.droppedEntries << "}";
+    }
+}
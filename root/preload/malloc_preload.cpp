@@ -0,0 +1,264 @@
+// Allocator interposer for profiling unmodified binaries on Linux.
+// It replaces the libc allocation functions and feeds every call into a memory profiler, so memory coming from C
+// libraries gets recorded too, not only what goes through operator new.
+//
+// Usage: LD_PRELOAD=/path/to/libMemProfileViewer_preload.so ./program
+//
+// Configured through environment variables:
+//   MEMPROFILE_OUTPUT           Path of the trace. Defaults to memprofile.mpvt, or memprofile.json for JSON traces.
+//   MEMPROFILE_FORMAT           "binary" (default) or "json".
+//   MEMPROFILE_MODE             "streaming" (default), "full", "sampled" or "aggregate". See MemoryProfileMode.
+//   MEMPROFILE_SAMPLE_INTERVAL  Mean bytes between samples for the sampled mode.
+//   MEMPROFILE_COUNTERS         Name of a shared memory segment to publish the live counters into while the program
+//                               runs. See InstrumentationMemory::PublishCounters and MemProfileViewer_memcounters.
+//   MEMPROFILE_EVENTS           Name of a shared memory segment to publish every allocation into, for the viewer to
+//                               attach to with --attach. See InstrumentationMemory::PublishEvents.
+//   MEMPROFILE_COUNTER_INTERVAL Milliseconds between two samples of the live counters written into the trace as counter
+//                               events. Not sampled when unset. See InstrumentationMemory::SampleCounters.
+//
+// Binary traces can be turned into JSON with MemProfileViewer_trace2json.
+// PROFILE is left at 0 so operator new isn't replaced too, it reaches malloc anyway and would be recorded twice.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <malloc.h>
+
+#include <profiler.h>
+
+// glibc's own implementations, the interposed functions forward to these.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* block, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void* __libc_valloc(size_t size);
+extern "C" void* __libc_pvalloc(size_t size);
+extern "C" void __libc_free(void* block);
+
+namespace
+{
+    /**
+     * Storage of the memory profiler. It's built in place so its lifetime doesn't depend on static destruction order.
+     */
+    alignas(InstrumentationMemory) unsigned char profilerStorage[sizeof(InstrumentationMemory)];
+    InstrumentationMemory* profiler = nullptr; /**< The memory profiler, nullptr until the library is initialized. */
+    std::atomic<bool> running = false;
+    /**< Whether allocations should be handed to the profiler. Checked once before taking a MemoryUseGuard so calls made
+     * without a profiler skip it, and again under it, so once Shutdown cleared it and the profiler stopped no thread can
+     * still be inside the profiler. */
+
+    /**
+     * Hand an allocation to the memory profiler.
+     * @param block The allocated block, nothing is recorded if it's nullptr
+     * @param size The requested size
+     */
+    void RecordAllocation(void* block, const size_t size)
+    {
+        if (block == nullptr || !running.load(std::memory_order_relaxed) || !ProfileLock::GetSaveProfiling())
+            return;
+
+        ProfileLock lock;
+        MemoryUseGuard memoryUse;
+        if (!running.load())
+            return;
+        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
+            // malloc blocks are untyped byte arrays
+            memoryInstrumentation->Register_push(block, size, true);
+    }
+
+    /**
+     * Hand a deallocation to the memory profiler. Must be called before the block goes back to libc.
+     * @param block The block being released
+     */
+    void RecordDeallocation(void* block)
+    {
+        if (block == nullptr || !running.load(std::memory_order_relaxed) || !ProfileLock::GetSaveProfiling())
+            return;
+
+        ProfileLock lock;
+        MemoryUseGuard memoryUse;
+        if (!running.load())
+            return;
+        if (const auto memoryInstrumentation = Instrumentor::GetCurrentMemoryInstrumentation())
+            memoryInstrumentation->Register_pop(block);
+    }
+
+    /**
+     * Check whether an environment variable has a given value.
+     * @param name Name of the variable
+     * @param value Expected value
+     * @return Whether the variable is set to the value
+     */
+    bool EnvironmentIs(const char* name, const char* value)
+    {
+        const char* current = std::getenv(name);
+        return current != nullptr && std::strcmp(current, value) == 0;
+    }
+
+    /**
+     * Stop the profiler and write the trace. Registered with atexit after the Instrumentor gets built so it runs
+     * before the Instrumentor is destroyed. Other threads can still be allocating, Stop waits for the ones that are
+     * recording and the ones coming after see running cleared.
+     */
+    void Shutdown()
+    {
+        ProfileLock lock;
+        running.store(false);
+        profiler->Stop();
+        profiler->~InstrumentationMemory();
+        Instrumentor::Get().EndSession();
+    }
+
+    /**
+     * Start the session and the memory profiler when the library gets loaded.
+     */
+    __attribute__((constructor)) void Initialize()
+    {
+        ProfileLock lock;
+
+        const bool binary = !EnvironmentIs("MEMPROFILE_FORMAT", "json");
+        const char* output = std::getenv("MEMPROFILE_OUTPUT");
+        if (output == nullptr)
+            output = binary ? "memprofile.mpvt" : "memprofile.json";
+
+        MemoryProfileMode mode = MemoryProfileMode::STREAMING;
+        if (EnvironmentIs("MEMPROFILE_MODE", "full"))
+            mode = MemoryProfileMode::FULL;
+        else if (EnvironmentIs("MEMPROFILE_MODE", "sampled"))
+            mode = MemoryProfileMode::SAMPLED;
+        else if (EnvironmentIs("MEMPROFILE_MODE", "aggregate"))
+            mode = MemoryProfileMode::AGGREGATE;
+
+        size_t sampleInterval = InstrumentationMemory::defaultSampleInterval;
+        if (const char* interval = std::getenv("MEMPROFILE_SAMPLE_INTERVAL"))
+            sampleInterval = std::strtoull(interval, nullptr, 10);
+
+        Instrumentor::Get().BeginSession("LD_PRELOAD", output, binary ? TraceFormat::BINARY : TraceFormat::JSON);
+        profiler = new(profilerStorage) InstrumentationMemory("LD_PRELOAD", mode, sampleInterval);
+        if (const char* counters = std::getenv("MEMPROFILE_COUNTERS"))
+        {
+            try
+            {
+                profiler->PublishCounters(counters);
+            }
+            catch (const char* error)
+            {
+                // Not worth taking the program down for, the trace still gets written.
+                std::fputs(error, stderr);
+                std::fputs("\n", stderr);
+            }
+        }
+        if (const char* events = std::getenv("MEMPROFILE_EVENTS"))
+        {
+            try
+            {
+                profiler->PublishEvents(events);
+            }
+            catch (const char* error)
+            {
+                std::fputs(error, stderr);
+                std::fputs("\n", stderr);
+            }
+        }
+        if (const char* interval = std::getenv("MEMPROFILE_COUNTER_INTERVAL"))
+        {
+            profiler->SampleCounters(std::chrono::milliseconds(std::strtoull(interval, nullptr, 10)));
+        }
+        std::atexit(Shutdown);
+        running.store(true);
+    }
+}
+
+extern "C" {
+// ReSharper disable CppInconsistentNaming
+void* malloc(const size_t size)
+{
+    void* block = __libc_malloc(size);
+    RecordAllocation(block, size);
+    return block;
+}
+
+void* calloc(const size_t count, const size_t size)
+{
+    void* block = __libc_calloc(count, size);
+    RecordAllocation(block, count * size);
+    return block;
+}
+
+void* realloc(void* block, const size_t size)
+{
+    if (block == nullptr)
+        return malloc(size);
+
+    // The old block is released first so a streaming trace never shows two live blocks at the same address.
+    const size_t oldSize = malloc_usable_size(block);
+    RecordDeallocation(block);
+    void* newBlock = __libc_realloc(block, size);
+    if (newBlock != nullptr)
+        RecordAllocation(newBlock, size);
+    else if (size != 0)
+        RecordAllocation(block, oldSize); // Failed, the old block is still alive
+    return newBlock;
+}
+
+void* reallocarray(void* block, const size_t count, const size_t size)
+{
+    // glibc's own reallocarray calls its realloc directly, it would skip the one above.
+    size_t bytes = 0;
+    if (__builtin_mul_overflow(count, size, &bytes))
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(block, bytes);
+}
+
+void free(void* block)
+{
+    RecordDeallocation(block);
+    __libc_free(block);
+}
+
+void* memalign(const size_t alignment, const size_t size)
+{
+    void* block = __libc_memalign(alignment, size);
+    RecordAllocation(block, size);
+    return block;
+}
+
+void* aligned_alloc(const size_t alignment, const size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void* valloc(const size_t size)
+{
+    void* block = __libc_valloc(size);
+    RecordAllocation(block, size);
+    return block;
+}
+
+void* pvalloc(const size_t size)
+{
+    void* block = __libc_pvalloc(size);
+    RecordAllocation(block, size);
+    return block;
+}
+
+int posix_memalign(void** result, const size_t alignment, const size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || !std::has_single_bit(alignment))
+        return EINVAL;
+
+    void* block = memalign(alignment, size);
+    if (block == nullptr)
+        return ENOMEM;
+
+    *result = block;
+    return 0;
+}
+// ReSharper restore CppInconsistentNaming
+}
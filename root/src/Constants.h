@@ -1,4 +1,8 @@
-﻿namespace  fw
-{
-    static int maxTextureSize = -1;
-}
+﻿namespace  fw
+{
+    static int maxTextureSize = -1;
+
+    constexpr double frameTimeBudget = 1000.0 / 60.0; /**< Milliseconds a frame can take before it's over budget */
+    constexpr unsigned long long frameAllocationBudget = 64; /**< Allocations a frame can make before it's over budget */
+    constexpr unsigned long long frameBytesBudget = 64 * 1024; /**< Bytes a frame can allocate before it's over budget */
+}
@@ -1,215 +1,504 @@
-﻿// ReSharper disable CppExpressionWithoutSideEffects
-module;
-
-// Flecs doesn't work properly unless included like this
-#include <flecs.h>;
-
-export module FilesModule;
-
-// System headers
-import <fstream>;
-import <string>;
-import <vector>;
-
-// Lib and internal headers
-import <raylib.h>;
-import <nlohmann/json.hpp>;
-
-using json = nlohmann::json;
-
-/**
- * Namespace for the project
- */
-export namespace mem_profile_viewer
-{
-    /**
-     * flecs module declaration
-     */
-    class FilesModule
-    {
-    public:
-        // ReSharper disable once CppNonExplicitConvertingConstructor
-        /**
-         * Constructor for use with flecs import
-         * @param world reference to the world where the module is to be registered
-         */
-        FilesModule(const flecs::world& world);
-    };
-
-    /**
-     * Enum for categories of memory allocations
-     */
-    enum class CATEGORY
-    {
-        UNKNOWN,
-        DEALLOCATED,
-        MEM_LEAK
-    };
-
-    /**
-     * Data structure to hold the data of memory trace entries.
-     */
-    struct Memory_TraceEntry
-    {
-        CATEGORY category = CATEGORY::UNKNOWN; /**< The category of the data entry */
-        double duration = -1.0;
-        /**< How long the memory was allocated for. @remark In milliseconds in memory but microseconds in the file.*/
-        std::string memLocation = ""; /**< memory address of what was allocated */
-        unsigned long long threadId = 0; /**< ID of the thread that caused the allocation */
-        unsigned long long memSize = 0; /**< How much memory was allocated */
-        std::vector<std::string> callstack = {}; /**< The callstack at the moment of the allocation. */
-
-        /**
-         * default constructor for array creation/vector reservations
-         */
-        Memory_TraceEntry() = default;
-
-        /**
-         * Constructor to construct the entries (mostly) in place
-         * @param category The category of the allocation
-         * @param duration how long was the memory allocated
-         * @param memLocation Where the memory was allocated
-         * @param threadId the ID the memory was allocated at
-         * @param memSize how much memory was allocated
-         * @param callstack The callstack at the moment of the allocation
-         */
-        Memory_TraceEntry(CATEGORY category, double duration, const std::string& memLocation,
-                          unsigned long long threadId,
-                          unsigned long long memSize, const std::vector<std::string>& callstack) :
-            category(category),
-            duration(duration),
-            memLocation(memLocation),
-            threadId(threadId),
-            memSize(memSize),
-            callstack(callstack)
-        {
-        }
-
-        bool operator==(const Memory_TraceEntry& other) const
-        {
-            bool result = true;
-
-            result &= (&this->memLocation == &other.memLocation);
-            result &= (&this->duration == &other.duration);
-            result &= (&this->memSize == &other.memSize);
-            result &= (&this->threadId == &other.threadId);
-            result &= (&this->category == &other.category);
-            result &= (&this->callstack == &other.callstack);
-
-            return result;
-        }
-
-        bool operator!=(const Memory_TraceEntry& other) const
-        {
-            return !(*this == other);
-        }
-    };
-
-    /**
-     * Component to hold the file dropped into the window.
-     */
-    struct File_Holder
-    {
-        std::string name; /**< Name of the file */
-        std::ifstream file; /**< handler of the file stream */
-        std::vector<Memory_TraceEntry> entries; /**< Entries in the file */
-
-        /**
-         * Destructor to ensure file is closed properly
-         */
-        ~File_Holder()
-        {
-            if (file.is_open())
-                file.close();
-        }
-    };
-}
-
-module :private;
-// private forward declarations
-/**
- * private callback for flecs system to check whether a new file got dropped into the window and load the data.
- * @param it flecs iterator
- * @param file component holding the file information
- */
-void checkFileDropped(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file);
-
-// Module implementations
-mem_profile_viewer::FilesModule::FilesModule(const flecs::world& world)
-{
-    // Declare module
-    world.module<mem_profile_viewer::FilesModule>("FilesModule");
-
-    // Describe components
-    world.component<mem_profile_viewer::File_Holder>("File_Holder")
-         .member<std::string>("name")
-         .member<std::ofstream>("file");
-
-    // Add component to singleton
-
-    world.add<mem_profile_viewer::File_Holder>();
-
-    // define system
-    world.system<mem_profile_viewer::File_Holder>()
-         .term_at<mem_profile_viewer::File_Holder>(0).singleton()
-         .kind(flecs::OnUpdate)
-         .each(checkFileDropped);
-}
-
-void checkFileDropped(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file)
-{
-    if (!IsFileDropped())
-    {
-        return;
-    }
-
-    auto filePaths = LoadDroppedFiles();
-    if (filePaths.count == 0)
-    {
-        return; // If no files exit early
-    }
-
-    std::string filepath = filePaths.paths[0];
-
-    if (filepath == file.name)
-    {
-        return; // already processed
-    }
-    
-    if (file.file.is_open())
-    {
-        file.file.close();
-    }
-
-    file.name = filepath;
-    file.file.open(filepath);
-    auto json = json::parse(file.file);
-    auto traceEvents = json["traceEvents"];
-
-    if (!file.entries.empty())
-    {
-        file.entries.clear();
-    }
-
-    for (size_t i = 0; i < traceEvents.size(); ++i)
-    {
-        // (CATEGORY category, double duration, std::string& memLocation,
-        // unsigned long long threadId, unsigned long long memSize, int vectorSize)
-        mem_profile_viewer::CATEGORY category = traceEvents[i]["cat"].get<std::string>().find("Deallocated") !=
-                                                std::string::npos
-                                                    ? mem_profile_viewer::CATEGORY::DEALLOCATED
-                                                    : mem_profile_viewer::CATEGORY::MEM_LEAK;
-
-
-        file.entries.emplace_back(
-            category,
-            traceEvents[i]["dur(us)"].get<long long>() / 1000.0,
-            traceEvents[i]["name"].get<std::string>(),
-            traceEvents[i]["tid"].get<unsigned long long>(),
-            traceEvents[i]["size"].get<unsigned long long>(),
-            traceEvents[i]["callStack"].get<std::vector<std::string>>()
-        );
-    }
-
-    UnloadDroppedFiles(filePaths);
-}
+﻿// ReSharper disable CppExpressionWithoutSideEffects
+module;
+
+// Flecs doesn't work properly unless included like this
+#include <flecs.h>;
+#include <profiler_shm.h>
+#include <trace_format.h>
+
+export module FilesModule;
+
+// System headers
+import <algorithm>;
+import <fstream>;
+import <memory>;
+import <sstream>;
+import <string>;
+import <unordered_map>;
+import <vector>;
+
+// Lib and internal headers
+import <raylib.h>;
+import <nlohmann/json.hpp>;
+
+using json = nlohmann::json;
+
+namespace constants::files_module_constants
+{
+    constexpr size_t c_live_events_per_frame = 1 << 16; /**< Most events taken from a live source every frame. */
+    constexpr float c_live_retry_seconds = 0.5f; /**< Time between attempts to open a live source. */
+}
+
+/**
+ * Namespace for the project
+ */
+export namespace mem_profile_viewer
+{
+    /**
+     * flecs module declaration
+     */
+    class FilesModule
+    {
+    public:
+        // ReSharper disable once CppNonExplicitConvertingConstructor
+        /**
+         * Constructor for use with flecs import
+         * @param world reference to the world where the module is to be registered
+         */
+        FilesModule(const flecs::world& world);
+    };
+
+    /**
+     * Enum for categories of memory allocations
+     */
+    enum class CATEGORY
+    {
+        UNKNOWN,
+        DEALLOCATED,
+        MEM_LEAK
+    };
+
+    /**
+     * Data structure to hold the data of memory trace entries.
+     */
+    struct Memory_TraceEntry
+    {
+        CATEGORY category = CATEGORY::UNKNOWN; /**< The category of the data entry */
+        double duration = -1.0;
+        /**< How long the memory was allocated for. @remark In milliseconds in memory but microseconds in the file.*/
+        double start = -1.0;
+        /**< When the memory was allocated, -1 if the file doesn't say. @remark In milliseconds in memory but microseconds in the file.*/
+        std::string memLocation = ""; /**< memory address of what was allocated */
+        unsigned long long threadId = 0; /**< ID of the thread that caused the allocation */
+        unsigned long long memSize = 0; /**< How much memory was allocated */
+        std::vector<std::string> callstack = {}; /**< The callstack at the moment of the allocation. */
+
+        /**
+         * default constructor for array creation/vector reservations
+         */
+        Memory_TraceEntry() = default;
+
+        /**
+         * Constructor to construct the entries (mostly) in place
+         * @param category The category of the allocation
+         * @param duration how long was the memory allocated
+         * @param memLocation Where the memory was allocated
+         * @param threadId the ID the memory was allocated at
+         * @param memSize how much memory was allocated
+         * @param callstack The callstack at the moment of the allocation
+         * @param start when the memory was allocated, -1 if unknown
+         */
+        Memory_TraceEntry(CATEGORY category, double duration, const std::string& memLocation,
+                          unsigned long long threadId,
+                          unsigned long long memSize, const std::vector<std::string>& callstack,
+                          double start = -1.0) :
+            category(category),
+            duration(duration),
+            start(start),
+            memLocation(memLocation),
+            threadId(threadId),
+            memSize(memSize),
+            callstack(callstack)
+        {
+        }
+
+        bool operator==(const Memory_TraceEntry& other) const
+        {
+            bool result = true;
+
+            result &= (&this->memLocation == &other.memLocation);
+            result &= (&this->duration == &other.duration);
+            result &= (&this->memSize == &other.memSize);
+            result &= (&this->threadId == &other.threadId);
+            result &= (&this->category == &other.category);
+            result &= (&this->callstack == &other.callstack);
+
+            return result;
+        }
+
+        bool operator!=(const Memory_TraceEntry& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Data structure to hold a frame of a program that marks them with PROFILE_FRAME_MARK.
+     */
+    struct Frame_Entry
+    {
+        unsigned long long number = 0; /**< Number of the frame, the first one is 1 */
+        double start = 0.0;
+        /**< When the frame started. @remark In milliseconds in memory but microseconds in the file.*/
+        double duration = 0.0;
+        /**< How long the frame took. @remark In milliseconds in memory but microseconds in the file.*/
+        unsigned long long allocations = 0; /**< How many allocations happened during the frame */
+        unsigned long long bytesAllocated = 0; /**< How much memory was allocated during the frame */
+        long long firstEntry = -1; /**< Index of the first entry allocated during the frame, -1 if none */
+    };
+
+    /**
+     * Component to hold the file dropped into the window.
+     */
+    struct File_Holder
+    {
+        std::string name; /**< Name of the file */
+        std::ifstream file; /**< handler of the file stream */
+        std::vector<Memory_TraceEntry> entries; /**< Entries in the file */
+        std::vector<Frame_Entry> frames; /**< Frames in the file, empty if the program didn't mark them */
+        long long selectedFrame = -1; /**< Index of the frame the view last jumped to, -1 if none */
+
+        /**
+         * Destructor to ensure file is closed properly
+         */
+        ~File_Holder()
+        {
+            if (file.is_open())
+                file.close();
+        }
+    };
+
+    /**
+     * Component to follow a running program through the events its memory profiler publishes with
+     * InstrumentationMemory::PublishEvents. While attached the events replace the entries of the File_Holder, dropping a
+     * file detaches it.
+     */
+    struct Live_Source
+    {
+        std::string name; /**< Name of the shared memory segment */
+        std::unique_ptr<profiler_shm::SharedMemory> segment = nullptr; /**< Mapping of the segment once it exists */
+        profiler_shm::EventRing* ring = nullptr; /**< Ring inside the segment, nullptr until attached */
+        std::unordered_map<uint64_t, std::pair<size_t, int64_t>> liveAllocations = {};
+        /**< Blocks still allocated, address -> (entry, start in ticks) */
+        float retryTimer = 0.0f; /**< Seconds until the next attempt to open the segment */
+    };
+}
+
+module :private;
+// private forward declarations
+/**
+ * private callback for flecs system to check whether a new file got dropped into the window and load the data.
+ * @param it flecs iterator
+ * @param file component holding the file information
+ */
+void checkFileDropped(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file);
+
+/**
+ * private helper to parse a results file regardless of whether it was written as JSON or in the binary trace format.
+ * @param file stream of the results file, opened in binary mode
+ * @return the parsed JSON document
+ */
+json parseTraceFile(std::ifstream& file);
+
+/**
+ * private callback for flecs system to take the events published by a live source and turn them into entries.
+ * @param it flecs iterator
+ * @param file component holding the entries
+ * @param source component holding the live source
+ */
+void consumeLiveEvents(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file,
+                       mem_profile_viewer::Live_Source& source);
+
+/**
+ * private helper to find the first entry of every frame by when the entries were allocated. Only streaming sessions
+ * write entries in the order they happen, the other modes write them once the memory gets freed or the session ends.
+ * @param file file holder with the entries and frames already parsed
+ */
+void mapFramesToEntries(mem_profile_viewer::File_Holder& file);
+
+// Module implementations
+mem_profile_viewer::FilesModule::FilesModule(const flecs::world& world)
+{
+    // Declare module
+    world.module<mem_profile_viewer::FilesModule>("FilesModule");
+
+    // Describe components
+    world.component<mem_profile_viewer::File_Holder>("File_Holder")
+         .member<std::string>("name")
+         .member<std::ofstream>("file");
+
+    world.component<mem_profile_viewer::Live_Source>("Live_Source")
+         .member<std::string>("name");
+
+    // Add component to singleton
+
+    world.add<mem_profile_viewer::File_Holder>();
+
+    // define system
+    world.system<mem_profile_viewer::File_Holder>()
+         .term_at<mem_profile_viewer::File_Holder>(0).singleton()
+         .kind(flecs::OnUpdate)
+         .each(checkFileDropped);
+
+    // Only runs once a Live_Source singleton gets set
+    world.system<mem_profile_viewer::File_Holder, mem_profile_viewer::Live_Source>()
+         .term_at(0).singleton()
+         .term_at(1).singleton()
+         .kind(flecs::OnUpdate)
+         .each(consumeLiveEvents);
+}
+
+void checkFileDropped(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file)
+{
+    if (!IsFileDropped())
+    {
+        return;
+    }
+
+    auto filePaths = LoadDroppedFiles();
+    if (filePaths.count == 0)
+    {
+        return; // If no files exit early
+    }
+
+    std::string filepath = filePaths.paths[0];
+
+    if (filepath == file.name)
+    {
+        return; // already processed
+    }
+    
+    if (file.file.is_open())
+    {
+        file.file.close();
+    }
+
+    file.name = filepath;
+    file.file.open(filepath, std::ios::binary);
+    auto json = parseTraceFile(file.file);
+    auto traceEvents = json["traceEvents"];
+
+    if (!file.entries.empty())
+    {
+        file.entries.clear();
+    }
+    file.frames.clear();
+    file.selectedFrame = -1;
+
+    // Newer files store every unique callstack once and entries refer to them by stackId
+    std::vector<std::vector<std::string>> callstacks;
+    if (json.contains("stacks") && json.contains("frames"))
+    {
+        const auto frames = json["frames"].get<std::vector<std::string>>();
+        const auto& stacks = json["stacks"];
+        callstacks.reserve(stacks.size());
+        for (const auto& stack : stacks)
+        {
+            auto& callstack = callstacks.emplace_back();
+            callstack.reserve(stack.size());
+            for (const auto& frameId : stack)
+            {
+                callstack.push_back(frames[frameId.get<size_t>()]);
+            }
+        }
+    }
+
+    // Streaming sessions write allocations and deallocations as separate events, they get paired up by address.
+    // Allocations that never get paired were still live when the session ended, so they are leaks.
+    std::unordered_map<std::string, std::pair<size_t, double>> liveAllocations; // address -> (entry, start)
+
+    for (size_t i = 0; i < traceEvents.size(); ++i)
+    {
+        const auto eventCategory = traceEvents[i]["cat"].get<std::string>();
+        if (eventCategory == "alloc")
+        {
+            const auto memLocation = traceEvents[i]["name"].get<std::string>();
+            const double start = traceEvents[i]["ts"].get<double>();
+            liveAllocations[memLocation] = {file.entries.size(), start};
+            file.entries.emplace_back(
+                mem_profile_viewer::CATEGORY::MEM_LEAK,
+                -1.0,
+                memLocation,
+                traceEvents[i]["tid"].get<unsigned long long>(),
+                traceEvents[i]["size"].get<unsigned long long>(),
+                callstacks[traceEvents[i]["stackId"].get<size_t>()],
+                start / 1000.0
+            );
+            continue;
+        }
+        if (eventCategory == "free")
+        {
+            const auto liveAllocation = liveAllocations.find(traceEvents[i]["name"].get<std::string>());
+            if (liveAllocation != liveAllocations.end())
+            {
+                auto& [entryIndex, start] = liveAllocation->second;
+                file.entries[entryIndex].category = mem_profile_viewer::CATEGORY::DEALLOCATED;
+                file.entries[entryIndex].duration = (traceEvents[i]["ts"].get<double>() - start) / 1000.0;
+                liveAllocations.erase(liveAllocation);
+            }
+            continue;
+        }
+        if (eventCategory == "frame")
+        {
+            const auto& args = traceEvents[i]["args"];
+            file.frames.push_back({
+                .number = args["frame"].get<unsigned long long>(),
+                .start = traceEvents[i]["ts"].get<double>() / 1000.0,
+                .duration = traceEvents[i]["dur"].get<double>() / 1000.0,
+                .allocations = args["allocations"].get<unsigned long long>(),
+                .bytesAllocated = args["bytesAllocated"].get<unsigned long long>()
+            });
+            continue;
+        }
+        if (eventCategory != "Deallocated mem" && eventCategory != "Memory leaked")
+        {
+            continue; // Sessions that also time scopes mix timers and high-water marks in, they aren't allocations
+        }
+
+        // (CATEGORY category, double duration, std::string& memLocation,
+        // unsigned long long threadId, unsigned long long memSize, int vectorSize)
+        mem_profile_viewer::CATEGORY category = eventCategory.find("Deallocated") != std::string::npos
+                                                    ? mem_profile_viewer::CATEGORY::DEALLOCATED
+                                                    : mem_profile_viewer::CATEGORY::MEM_LEAK;
+
+
+        file.entries.emplace_back(
+            category,
+            traceEvents[i]["dur(us)"].get<double>() / 1000.0,
+            traceEvents[i]["name"].get<std::string>(),
+            traceEvents[i]["tid"].get<unsigned long long>(),
+            traceEvents[i]["size"].get<unsigned long long>(),
+            traceEvents[i].contains("stackId")
+                ? callstacks[traceEvents[i]["stackId"].get<size_t>()]
+                : traceEvents[i]["callStack"].get<std::vector<std::string>>(),
+            traceEvents[i].contains("tStart") ? traceEvents[i]["tStart"].get<double>() / 1000.0 : -1.0
+        );
+    }
+
+    mapFramesToEntries(file);
+
+    UnloadDroppedFiles(filePaths);
+}
+
+void mapFramesToEntries(mem_profile_viewer::File_Holder& file)
+{
+    if (file.frames.empty())
+    {
+        return;
+    }
+
+    // Frames follow each other, so they're already sorted by start
+    for (size_t i = 0; i < file.entries.size(); ++i)
+    {
+        const double start = file.entries[i].start;
+        if (start < 0.0)
+        {
+            continue;
+        }
+
+        // Last frame starting at or before the allocation, it owns the entry if the allocation happened before it ended
+        const auto next = std::upper_bound(file.frames.begin(), file.frames.end(), start,
+                                           [](double time, const mem_profile_viewer::Frame_Entry& frame)
+                                           {
+                                               return time < frame.start;
+                                           });
+        if (next == file.frames.begin())
+        {
+            continue;
+        }
+
+        auto& frame = *std::prev(next);
+        if (start >= frame.start + frame.duration)
+        {
+            continue;
+        }
+
+        // Entries aren't time ordered outside of streaming sessions, so keep the lowest index rather than the first hit
+        if (frame.firstEntry < 0 || static_cast<long long>(i) < frame.firstEntry)
+        {
+            frame.firstEntry = static_cast<long long>(i);
+        }
+    }
+}
+
+void consumeLiveEvents(flecs::iter& it, size_t, mem_profile_viewer::File_Holder& file,
+                       mem_profile_viewer::Live_Source& source)
+{
+    if (source.ring == nullptr)
+    {
+        // The program may not have started yet
+        source.retryTimer -= it.delta_time();
+        if (source.retryTimer > 0.0f)
+        {
+            return;
+        }
+        source.retryTimer = constants::files_module_constants::c_live_retry_seconds;
+
+        if (source.segment == nullptr)
+        {
+            source.segment = std::make_unique<profiler_shm::SharedMemory>();
+        }
+        source.ring = profiler_shm::OpenEvents(*source.segment, source.name);
+        if (source.ring == nullptr)
+        {
+            return;
+        }
+
+        if (file.file.is_open())
+        {
+            file.file.close();
+        }
+        file.name = source.name;
+        file.entries.clear();
+        file.frames.clear();
+        file.selectedFrame = -1;
+        source.liveAllocations.clear();
+    }
+
+    if (file.name != source.name)
+    {
+        // A file got dropped, its entries aren't ours to update anymore
+        it.world().remove<mem_profile_viewer::Live_Source>();
+        return;
+    }
+
+    const double ticksPerMillisecond = static_cast<double>(source.ring->ticksPerSecond) / 1000.0;
+    profiler_shm::LiveEvent event;
+    for (size_t i = 0; i < constants::files_module_constants::c_live_events_per_frame; ++i)
+    {
+        if (!profiler_shm::PopEvent(*source.ring, event))
+        {
+            break;
+        }
+
+        if (event.kind == profiler_shm::EVENT::ALLOCATION)
+        {
+            // Same format the profiler writes addresses with
+            std::ostringstream memLocation;
+            memLocation << reinterpret_cast<void*>(event.address);
+
+            source.liveAllocations[event.address] = {file.entries.size(), event.timestamp};
+            file.entries.emplace_back(
+                mem_profile_viewer::CATEGORY::MEM_LEAK,
+                -1.0,
+                memLocation.str(),
+                event.threadId,
+                event.size,
+                std::vector<std::string>{},
+                static_cast<double>(event.timestamp) / ticksPerMillisecond
+            );
+            continue;
+        }
+
+        const auto liveAllocation = source.liveAllocations.find(event.address);
+        if (liveAllocation != source.liveAllocations.end())
+        {
+            auto& [entryIndex, start] = liveAllocation->second;
+            file.entries[entryIndex].category = mem_profile_viewer::CATEGORY::DEALLOCATED;
+            file.entries[entryIndex].duration = static_cast<double>(event.timestamp - start) / ticksPerMillisecond;
+            source.liveAllocations.erase(liveAllocation);
+        }
+    }
+}
+
+json parseTraceFile(std::ifstream& file)
+{
+    if (!trace_format::IsBinaryTrace(file))
+    {
+        return json::parse(file);
+    }
+
+    std::stringstream converted;
+    trace_format::ConvertToJson(file, converted);
+    return json::parse(converted);
+}
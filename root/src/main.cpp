@@ -1,13 +1,14 @@
 #include <FWCore.h>
 #include <flecs.h>
 #include <stdexcept>
+#include <string_view>
 
 #include <profiler.h>
 
 import FilesModule;
 import ProfilingRenderer;
 
-int main()
+int main(const int argc, char** argv)
 {
     START_SESSION("TestMemoryCheckSession");
     // Double scoped for profiling potential memory leak
@@ -41,6 +42,15 @@ int main()
         world->import<mem_profile_viewer::rendering_module>();
         world->import<mem_profile_viewer::IOStateModule>();
 
+        // --attach <segment> follows a running program instead of waiting for a dropped file
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (std::string_view(argv[i]) == "--attach")
+            {
+                world->set<mem_profile_viewer::Live_Source>({.name = argv[i + 1]});
+            }
+        }
+
         //Clay_SetDebugModeEnabled(true);
 
         // Start program
@@ -0,0 +1,53 @@
+// Command line reader of the live counters a memory profiler publishes with InstrumentationMemory::PublishCounters.
+// Usage: MemProfileViewer_memcounters <segment name> [interval in milliseconds]
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <profiler_shm.h>
+
+int main(const int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <segment name> [interval in milliseconds]\n";
+        return 1;
+    }
+
+    const std::string segmentName = argv[1];
+    const std::chrono::milliseconds interval(argc > 2 ? std::stoul(argv[2]) : 500);
+
+    bool seen = false;
+    while (true)
+    {
+        // Opened again every time so the loop ends once the profiler removes the segment.
+        profiler_shm::SharedMemory segment;
+        if (!segment.Open(segmentName, sizeof(profiler_shm::CounterSegment)))
+        {
+            if (seen)
+            {
+                return 0;
+            }
+            std::cerr << "Could not open " << segmentName << "\n";
+            return 1;
+        }
+        seen = true;
+
+        profiler_shm::LiveCounters counters;
+        if (!profiler_shm::ReadCounters(*static_cast<const profiler_shm::CounterSegment*>(segment.Data()), counters))
+        {
+            std::cerr << segmentName << ": not a counters segment of version " << profiler_shm::countersVersion << "\n";
+            return 1;
+        }
+
+        std::cout << "live " << counters.liveBytes << " B"
+            << "  peak " << counters.peakBytes << " B"
+            << "  allocations " << counters.allocations << " (" << counters.allocationsPerSecond << "/s)"
+            << "  deallocations " << counters.deallocations << " (" << counters.deallocationsPerSecond << "/s)\n";
+
+        segment.Close();
+        std::this_thread::sleep_for(interval);
+    }
+}
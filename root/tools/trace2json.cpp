@@ -0,0 +1,40 @@
+// Command line converter from the binary trace format to the JSON layout read by the viewer and chrome://tracing.
+// Usage: MemProfileViewer_trace2json <input.mpvt> [output.json]
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <trace_format.h>
+
+int main(const int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.mpvt> [output.json]\n";
+        return 1;
+    }
+
+    const std::string inputPath = argv[1];
+    const std::string outputPath = argc > 2 ? argv[2] : inputPath + ".json";
+
+    std::ifstream input(inputPath, std::ios::binary);
+    if (!input.is_open())
+    {
+        std::cerr << "Could not open " << inputPath << "\n";
+        return 1;
+    }
+
+    std::ofstream output(outputPath);
+    try
+    {
+        trace_format::ConvertToJson(input, output);
+    }
+    catch (const char* error)
+    {
+        std::cerr << inputPath << ": " << error << "\n";
+        return 1;
+    }
+
+    return 0;
+}